@@ -1,3 +0,0 @@
-mkdir -p build/shaders
-glslc shaders/triangle.vert -o build/shaders/triangle.vert.spv
-glslc shaders/triangle.frag -o build/shaders/triangle.frag.spv
@@ -0,0 +1,6 @@
+#!/bin/sh
+set -e
+for obj in build/meshes/*.obj; do
+	[ -e "$obj" ] || continue
+	"$1" "$obj" "${obj%.obj}.mesh"
+done
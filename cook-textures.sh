@@ -0,0 +1,6 @@
+#!/bin/sh
+set -e
+for png in build/textures/*.png; do
+	[ -e "$png" ] || continue
+	"$1" "$png" "${png%.png}.ctex"
+done
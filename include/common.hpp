@@ -6,17 +6,115 @@
 #pragma GCC diagnostic ignored "-Wtype-limits"
 #include <vk_mem_alloc.h>
 #pragma GCC diagnostic pop
+#include <handles.hpp>
+#include <meshfile.hpp>
 #include <vulkan/vulkan.hpp>
 
 #ifndef ENGINE_COMMON_HPP
 #define ENGINE_COMMON_HPP
 
+// a group of uploads recorded into one command buffer and retired together
+struct UploadBatch {
+  uint64_t id = 0;
+  vk::CommandBuffer commands;
+  // only used with a dedicated transfer queue, takes ownership of the
+  // uploaded resources on the graphics queue
+  vk::CommandBuffer acquireCommands;
+  vk::Semaphore transferSemaphore;
+  vk::Fence fence;
+  vk::DeviceSize stagingBytes = 0;
+  // uploads too big for the staging ring get a staging buffer of their own,
+  // destroyed once the batch has finished
+  std::vector<vk::Buffer> dedicatedStaging;
+  std::vector<VmaAllocation> dedicatedAllocations;
+  bool recording = false;
+  // gpu profiler zone around the batch's graphics queue commands
+  uint32_t profileZone;
+};
+
+// one indexed draw of the scene, uniformOffset is the dynamic offset of its
+// MVP in the frame's uniform arena and textureSlot its slot in the bindless
+// texture array, instanced draws read a range of the frame's instance buffer
+struct DrawCommand {
+  uint32_t indexCount;
+  uint32_t firstIndex;
+  int32_t vertexOffset;
+  uint32_t uniformOffset;
+  uint32_t textureSlot;
+  uint32_t firstInstance;
+  uint32_t instanceCount;
+};
+
+// a sampled image, it can only be bound once the upload with uploadId has
+// finished, until then the placeholder is bound in its place
+struct Texture {
+  vk::Image image;
+  VmaAllocation allocation;
+  vk::ImageView view;
+  vk::Format format;
+  uint32_t mipLevels = 1;
+  uint64_t uploadId = 0;
+  bool ready = false;
+};
+
+// a buffer and its memory, allocated with vma
+struct GpuBuffer {
+  vk::Buffer buffer;
+  VmaAllocation allocation;
+  vk::DeviceSize size;
+};
+
+using BufferHandle = Handle<GpuBuffer>;
+using ImageHandle = Handle<Texture>;
+using SamplerHandle = Handle<vk::Sampler>;
+using PipelineHandle = Handle<vk::Pipeline>;
+
+// geometry drawn from one vertex and index buffer, its layout picks the
+// pipelines' vertex input and quantized positions are scaled back into the
+// bounds by the model matrix
+struct Mesh {
+  BufferHandle vertexBuffer;
+  BufferHandle indexBuffer;
+  MeshVertexLayout layout = MeshVertexLayout::Float;
+  vk::IndexType indexType = vk::IndexType::eUint16;
+  uint32_t indexCount;
+  float boundsMin[3];
+  float boundsMax[3];
+};
+
+using MeshHandle = Handle<Mesh>;
+
+// what the swapchain's present mode favours, throughput never waits for
+// vblank and may tear, low latency shows the newest finished frame at vblank
+// and vsync queues every frame behind it
+enum class PresentPolicy {
+  Throughput,
+  LowLatency,
+  Vsync,
+};
+
+// what the fragment shaders output, textured unless debugging the mesh's
+// vertex colors or texture coordinates, it's specialization constant 0 of
+// every fragment shader so changing it means building new pipelines
+enum class ShadingView {
+  Textured,
+  VertexColors,
+  TexCoords,
+};
+
 struct VulkanContext {
   const uint32_t HEIGHT = 600;
   const uint32_t WIDTH = 800;
 
   SDL_Window* win;
 
+  // when headless there is no window or surface, frames are rendered into
+  // offscreen images allocated with vma instead of swapchain images
+  bool headless = false;
+  const uint32_t OFFSCREEN_IMAGES = 3;
+  std::vector<VmaAllocation> offscreenAllocations;
+  uint32_t offscreenIndex = 0;
+
 #ifdef USE_VALIDATION_LAYERS
   const std::vector<const char*> validationLayers = {
       "VK_LAYER_KHRONOS_validation"};
@@ -37,48 +135,199 @@ struct VulkanContext {
   vk::Extent2D swapchainExtent;
   std::vector<vk::ImageView> swapchainImageViews;
 
+  // with VK_KHR_dynamic_rendering there is no render pass or framebuffers,
+  // the attachments are given when rendering begins and pipelines only know
+  // their formats
+  bool allowDynamicRendering = true;
+  bool dynamicRendering = false;
+  PFN_vkCmdBeginRenderingKHR cmdBeginRendering;
+  PFN_vkCmdEndRenderingKHR cmdEndRendering;
   vk::RenderPass renderPass;
   vk::PipelineLayout pipelineLayout;
-  vk::Pipeline pipeline;
+  PipelineHandle pipeline;
+
+  // the depth image is a transient of the frame graph, its format is the
+  // first one the device can render depth to
+  vk::Format depthFormat;
+  // with a depth prepass everything is drawn depth only first and the main
+  // pass only shades fragments whose depth is equal, without a render pass
+  // and framebuffer of its own with dynamic rendering
+  bool depthPrepass = false;
+  vk::RenderPass depthRenderPass;
+  vk::Framebuffer depthFramebuffer;
+  PipelineHandle prepassPipeline;
+  // msaa is the sample count asked for and samples the most of it the device
+  // can render, the multisampled color and depth are frame graph transients
+  // that never leave the main pass, the color is resolved into the swapchain
+  // image at its end
+  uint32_t msaa = 1;
+  vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+
+  ShadingView shadingView = ShadingView::Textured;
+
+  const std::string pipelineCachePath = "pipeline.cache";
+  vk::PipelineCache pipelineCache;
+  // hits and misses are only known with VK_EXT_pipeline_creation_feedback,
+  // pipelines are built on jobs too
+  bool pipelineFeedback = false;
+  std::atomic<uint32_t> pipelineCacheHits{0};
+  std::atomic<uint32_t> pipelineCacheMisses{0};
 
   std::vector<vk::Framebuffer> framebuffers;
 
   vk::CommandPool commandPool;
 
-  vk::Buffer vertexBuffer;
-  VmaAllocation vertexAllocation;
-  vk::Buffer indexBuffer;
-  VmaAllocation indexAllocation;
+  // long lived resources live in these rather than in fields of their own,
+  // see resources.cpp, handles to removed ones stop working right away but
+  // their slots are only reused once frames in flight are done with them
+  HandlePool<GpuBuffer> buffers;
+  HandlePool<Texture> images;
+  HandlePool<vk::Sampler> samplers;
+  HandlePool<vk::Pipeline> pipelines;
+  HandlePool<Mesh> meshes;
+
+  // from meshes/scene.mesh or the built in quad
+  const std::string meshPath = "meshes/scene.mesh";
+  MeshHandle sceneMesh;
 
   std::vector<vk::CommandBuffer> commandBuffers;
 
+  // draws are split into chunks recorded as jobs, each into its own secondary
+  // command buffer from its own pool, indexed by [frame][chunk], the depth
+  // prepass has its own chunks after the main pass' recordThreads
+  uint32_t drawCount = 1;
+  std::vector<DrawCommand> draws;
+  const uint32_t MIN_DRAWS_PER_THREAD = 256;
+  uint32_t recordThreads;
+  std::vector<std::vector<vk::CommandPool>> recordPools;
+  std::vector<std::vector<vk::CommandBuffer>> recordBuffers;
+
   vk::Queue graphicsQueue;
   vk::Queue presentQueue;
+  vk::Queue transferQueue;
+  uint32_t graphicsFamily;
+  uint32_t transferFamily;
+
+  // uploads are copied through a persistently mapped staging ring, space is
+  // reclaimed once the batch that used it has finished
+  const vk::DeviceSize STAGING_SIZE = 64 * 1024 * 1024;
+  vk::Buffer stagingBuffer;
+  VmaAllocation stagingAllocation;
+  uint8_t* stagingData;
+  vk::DeviceSize stagingHead = 0;
+  vk::DeviceSize stagingUsed = 0;
+  vk::DeviceSize stagingAlignment;
+  vk::CommandPool uploadPool;
+  vk::CommandPool acquirePool;
+  UploadBatch upload;
+  std::deque<UploadBatch> uploadsInFlight;
+  std::vector<UploadBatch> freeUploads;
+  uint64_t nextUploadId = 1;
+  uint64_t completedUploadId = 0;
 
   vk::DescriptorSetLayout descriptorLayout;
   vk::DescriptorPool descriptorPool;
   std::vector<vk::DescriptorSet> descriptorSets;
 
+  // per frame in flight, persistently mapped, big enough for one MVP per
+  // draw with UNIFORM_ARENA_SIZE left over for everything else
+  const vk::DeviceSize UNIFORM_ARENA_SIZE = 4 * 1024 * 1024;
+  vk::DeviceSize uniformArenaSize;
   std::vector<vk::Buffer> uniformBuffers;
   std::vector<VmaAllocation> uniformAllocations;
+  std::vector<uint8_t*> uniformData;
+  vk::DeviceSize uniformAlignment;
+  vk::DeviceSize uniformHead = 0;
 
   std::vector<vk::Semaphore> imageSemaphores;
   std::vector<vk::Semaphore> renderSemaphores;
   std::vector<vk::Fence> inFlightFences;
   std::vector<std::optional<vk::Fence>> imagesInFlight;
 
-  const uint8_t MAX_FRAMES_IN_FLIGHT = 2;
+  // frames the cpu can get ahead of the gpu, set before initVulkan, it's
+  // clamped to between 1 and MAX_FRAMES_IN_FLIGHT
+  const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+  uint32_t framesInFlight = 2;
   uint8_t currentFrame = 0;
+  // frames submitted so far
+  uint64_t frameNumber = 0;
+
+  // changes take effect when the swapchain is next recreated, see
+  // setPresentPolicy
+  PresentPolicy presentPolicy = PresentPolicy::LowLatency;
+  // the frame limiter holds each frame back until this many milliseconds
+  // after the previous one started, 0 turns it off
+  double targetFrameTime = 0.0;
+  std::chrono::steady_clock::time_point nextFrameStart;
 
   bool framebufferResized = false;
   bool minimized = false;
 
   VmaAllocator allocator;
 
-  vk::Image textureImage;
-  vk::ImageView textureImageView;
-  vk::Sampler textureSampler;
-  VmaAllocation textureAllocation;
+  // textures are decoded by jobs and uploaded a few per frame, at most
+  // STREAM_QUEUE_SIZE are being decoded or waiting for upload at once
+  const uint32_t STREAM_QUEUE_SIZE = 8;
+  const vk::DeviceSize STREAM_UPLOAD_BUDGET = 16 * 1024 * 1024;
+  Texture placeholderTexture;
+  SamplerHandle textureSampler;
+  ImageHandle sceneTexture;
+  // the view written to each frame's descriptor set
+  std::vector<vk::ImageView> boundTextures;
+
+  // with descriptor indexing every texture lives in one update after bind
+  // array in set 1, slot 0 is the placeholder and texture i is in slot i + 1,
+  // draws pick theirs with a push constant
+  bool bindless = false;
+  const uint32_t MAX_BINDLESS_TEXTURES = 4096;
+  uint32_t bindlessCapacity;
+  vk::DescriptorSetLayout textureLayout;
+  vk::DescriptorPool texturePool;
+  vk::DescriptorSet textureSet;
+
+  // per frame in flight and persistently mapped, one InstanceData per copy of
+  // the quad, the instanced path draws them all with a single call
+  bool instanced = true;
+  std::vector<vk::Buffer> instanceBuffers;
+  std::vector<VmaAllocation> instanceAllocations;
+  std::vector<uint8_t*> instanceData;
+  PipelineHandle instancedPipeline;
+
+  // gpu driven path, objects go into a storage buffer and a compute pass culls
+  // them into an indirect buffer drawn with one indirect count call, the
+  // buffers are per frame in flight
+  bool allowGpuDriven = true;
+  bool gpuDriven = false;
+  PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount;
+  std::vector<vk::Buffer> objectBuffers;
+  std::vector<VmaAllocation> objectAllocations;
+  std::vector<uint8_t*> objectData;
+  std::vector<vk::Buffer> indirectBuffers;
+  std::vector<VmaAllocation> indirectAllocations;
+  vk::DescriptorSetLayout cullLayout;
+  vk::DescriptorPool cullPool;
+  std::vector<vk::DescriptorSet> cullSets;
+  vk::PipelineLayout cullPipelineLayout;
+  PipelineHandle cullPipeline;
+  // the culling shader's local size, a specialization constant
+  const uint32_t CULL_GROUP_SIZE = 64;
+  vk::PipelineLayout gpuPipelineLayout;
+  PipelineHandle gpuPipeline;
+  PipelineHandle gpuPrepassPipeline;
+
+  // gpu frame timing, two timestamps per frame in flight
+  bool timestamps = false;
+  vk::QueryPool timestampPool;
+  float timestampPeriod;
+  std::vector<bool> timestampsPending;
+  std::vector<double> gpuFrameTimes;
+
+  // debug counter, fragment shader invocations of the main pass per pixel of
+  // the swapchain image, one pipeline statistics query per frame in flight
+  bool overdrawStats = false;
+  vk::QueryPool overdrawPool;
+  std::vector<bool> overdrawPending;
+  std::vector<double> overdraw;
 };
 
 #endif
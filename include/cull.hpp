@@ -0,0 +1,32 @@
+#ifndef ENGINE_CULL_HPP
+#define ENGINE_CULL_HPP
+
+#include <common.hpp>
+#include <vulkan.hpp>
+
+// one object of the scene as the culling and gpu vertex shaders see it, std430
+struct GpuObject {
+  glm::mat4 model;
+  // world space bounding sphere, center in xyz and radius in w
+  glm::vec4 sphere;
+  uint32_t indexCount;
+  uint32_t firstIndex;
+  int32_t vertexOffset;
+  uint32_t textureSlot;
+};
+
+// push constants of the culling shader
+struct CullConstants {
+  glm::vec4 planes[6];
+  uint32_t objectCount;
+};
+
+#endif
+void initCulling();
+void cleanupCulling();
+void requestGpuPipeline();
+GpuObject* frameObjects();
+void setCullView(const glm::mat4& viewProj);
+void clearDrawCount(vk::CommandBuffer commandBuffer);
+void recordCulling(vk::CommandBuffer commandBuffer);
+void recordIndirectDraws(vk::CommandBuffer commandBuffer, bool prepass);
@@ -0,0 +1,95 @@
+#include <bits/stdc++.h>
+
+#ifndef ENGINE_HANDLES_HPP
+#define ENGINE_HANDLES_HPP
+
+// refers to an item in a HandlePool, the generation tells a handle to a
+// removed item apart from one to whatever reused its slot, generations start
+// at 1 so the default handle is never valid
+template <typename T> struct Handle {
+  uint32_t index = 0;
+  uint32_t generation = 0;
+
+  bool operator==(const Handle& other) const {
+    return index == other.index && generation == other.generation;
+  }
+  bool operator!=(const Handle& other) const { return !(*this == other); }
+  explicit operator bool() const { return generation != 0; }
+};
+
+// items are packed together and the last one is moved into the gap when one
+// is removed, slots map the handles' stable indices onto them, a removed
+// item's slot is only reused after release so its index can't be handed out
+// while the gpu might still be using it
+template <typename T> struct HandlePool {
+  std::vector<T> items;
+  // slot of each item
+  std::vector<uint32_t> itemSlots;
+  // item in each slot and the generation of the handle that's valid for it
+  std::vector<uint32_t> slotItems;
+  std::vector<uint32_t> generations;
+  std::vector<uint32_t> freeSlots;
+
+  Handle<T> add(T item) {
+    uint32_t slot;
+    if (freeSlots.empty()) {
+      slot = static_cast<uint32_t>(slotItems.size());
+      slotItems.push_back(0);
+      generations.push_back(1);
+    } else {
+      slot = freeSlots.back();
+      freeSlots.pop_back();
+    }
+
+    slotItems[slot] = static_cast<uint32_t>(items.size());
+    items.push_back(std::move(item));
+    itemSlots.push_back(slot);
+
+    return {slot, generations[slot]};
+  }
+
+  bool contains(Handle<T> handle) const {
+    return handle.index < generations.size() &&
+           generations[handle.index] == handle.generation;
+  }
+
+  T* get(Handle<T> handle) {
+    return contains(handle) ? &items[slotItems[handle.index]] : nullptr;
+  }
+
+  // the handle stops working right away, the slot is kept until release
+  T remove(Handle<T> handle) {
+    if (!contains(handle))
+      throw std::invalid_argument("removing a stale handle");
+
+    uint32_t item = slotItems[handle.index];
+    T removed = std::move(items[item]);
+
+    if (item + 1 != items.size()) {
+      items[item] = std::move(items.back());
+      itemSlots[item] = itemSlots.back();
+      slotItems[itemSlots[item]] = item;
+    }
+    items.pop_back();
+    itemSlots.pop_back();
+
+    if (++generations[handle.index] == 0)
+      generations[handle.index] = 1;
+
+    return removed;
+  }
+
+  void release(uint32_t slot) { freeSlots.push_back(slot); }
+
+  // handles of every item, for cleaning up what's left
+  std::vector<Handle<T>> handles() const {
+    std::vector<Handle<T>> result;
+    for (uint32_t slot : itemSlots)
+      result.push_back({slot, generations[slot]});
+    return result;
+  }
+
+  size_t size() const { return items.size(); }
+};
+
+#endif
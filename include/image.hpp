@@ -3,9 +3,46 @@
 
 #include <common.hpp>
 #include <stb_image.h>
+#include <texfile.hpp>
 #include <vulkan.hpp>
 
+// pixels are always rgba8, free them with stbi_image_free
+struct DecodedImage {
+  stbi_uc* pixels = nullptr;
+  int width;
+  int height;
+};
+
+// a cooked texture file mapped into memory, header is null if there was no
+// file, release it with unmapCookedTexture
+struct CookedTexture {
+  void* mapping = nullptr;
+  size_t size = 0;
+  const TextureFileHeader* header = nullptr;
+  const TextureFileLevel* levels = nullptr;
+};
+
 #endif
-void createTextureImage();
-void createTextureImageView();
-vk::ImageView createImageView(vk::Image image, vk::Format format);
+vk::Image createImage(uint32_t width, uint32_t height, vk::Format format,
+                      vk::ImageTiling tiling, vk::ImageUsageFlags usage,
+                      vk::MemoryPropertyFlags props, VmaAllocation& allocation,
+                      uint32_t mipLevels = 1);
+void transitiionImageLayout(vk::CommandBuffer commandBuffer, vk::Image image,
+                            vk::Format format, vk::ImageLayout oldLayout,
+                            vk::ImageLayout newLayout,
+                            uint32_t baseMipLevel = 0, uint32_t levelCount = 1);
+uint32_t mipLevelCount(uint32_t width, uint32_t height);
+bool canGenerateMipmaps(vk::Format format);
+void generateMipmaps(vk::CommandBuffer commandBuffer, vk::Image image,
+                     vk::Format format, uint32_t width, uint32_t height,
+                     uint32_t mipLevels);
+DecodedImage decodeImage(const char* path);
+Texture createTexture(const DecodedImage& image);
+CookedTexture mapCookedTexture(const char* path);
+void unmapCookedTexture(CookedTexture& texture);
+vk::Format cookedTextureFormat(const TextureFileHeader& header);
+bool canSampleFormat(vk::Format format);
+Texture createCookedTexture(const CookedTexture& cooked);
+void destroyTexture(Texture& texture);
+vk::ImageView createImageView(vk::Image image, vk::Format format,
+                              uint32_t mipLevels = 1);
@@ -0,0 +1,33 @@
+#ifndef ENGINE_JOBS_HPP
+#define ENGINE_JOBS_HPP
+
+#include <bits/stdc++.h>
+
+using Job = std::function<void()>;
+
+// counts unfinished jobs, jobs queued with runJobAfter start once it reaches
+// zero, the first exception thrown by a job is rethrown by waitForJobs,
+// finished wakes waiters that ran out of jobs to help with
+struct JobCounter {
+  std::atomic<uint32_t> pending{0};
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::vector<std::pair<Job, JobCounter*>> continuations;
+  std::exception_ptr error;
+};
+
+#endif
+void initJobs(uint32_t threads);
+void cleanupJobs();
+uint32_t jobThreadCount();
+uint64_t jobSteals();
+uint64_t jobStealNs();
+void runJob(Job job, JobCounter* counter = nullptr);
+void runBackgroundJob(Job job, JobCounter* counter = nullptr);
+void runJobAfter(JobCounter& dependency, Job job,
+                 JobCounter* counter = nullptr);
+void waitForJobs(JobCounter& counter);
+void parallelFor(
+    uint32_t count, uint32_t chunks,
+    const std::function<void(uint32_t chunk, uint32_t first, uint32_t last)>&
+        job);
@@ -0,0 +1,29 @@
+#ifndef ENGINE_MESH_HPP
+#define ENGINE_MESH_HPP
+
+#include <common.hpp>
+#include <meshfile.hpp>
+#include <vulkan.hpp>
+
+// a mesh file mapped into memory, header is null if there was no file,
+// release it with unmapMesh
+struct MappedMesh {
+  void* mapping = nullptr;
+  size_t size = 0;
+  const MeshFileHeader* header = nullptr;
+  const uint8_t* vertices = nullptr;
+  const uint8_t* indices = nullptr;
+};
+
+#endif
+MappedMesh mapMesh(const char* path);
+void unmapMesh(MappedMesh& mesh);
+MeshHandle loadSceneMesh(const char* path);
+void createMeshBuffers(MeshHandle handle);
+vk::VertexInputBindingDescription
+meshBindingDescription(MeshVertexLayout layout);
+std::vector<vk::VertexInputAttributeDescription>
+meshAttributeDescriptions(MeshVertexLayout layout);
+glm::mat4 meshDequantize(const Mesh& mesh);
+std::array<glm::vec4, 8> meshCorners(const Mesh& mesh);
+glm::vec4 meshBoundingSphere(const Mesh& mesh);
@@ -0,0 +1,61 @@
+#include <bits/stdc++.h>
+
+#ifndef ENGINE_MESHFILE_HPP
+#define ENGINE_MESHFILE_HPP
+
+// meshes are written by meshcook and mapped by the engine, a file is a
+// MeshFileHeader followed by the vertex and index data at the offsets it
+// gives, both ready to be copied into buffers as they are
+
+enum class MeshVertexLayout : uint32_t {
+  Float = 0,
+  Quantized = 1,
+};
+
+// 32 bytes, the same layout as the engine's Vertex
+struct FloatVertex {
+  float position[3];
+  float color[3];
+  float texCoord[2];
+};
+
+// 16 bytes, positions are snorm16 relative to the mesh bounds, see
+// meshQuantizeScale, colors are unorm8 and texture coordinates unorm16 so
+// they can't repeat
+struct QuantizedVertex {
+  int16_t position[4];
+  uint8_t color[4];
+  uint16_t texCoord[2];
+};
+
+struct MeshFileHeader {
+  static constexpr uint32_t MAGIC = 0x48534d45; // "EMSH"
+  static constexpr uint32_t VERSION = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  MeshVertexLayout layout;
+  // 2 or 4 bytes
+  uint32_t indexSize;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  float boundsMin[3];
+  float boundsMax[3];
+  // from the start of the file and aligned to 16 bytes
+  uint64_t vertexOffset;
+  uint64_t indexOffset;
+};
+
+inline uint32_t meshVertexSize(MeshVertexLayout layout) {
+  return layout == MeshVertexLayout::Float ? sizeof(FloatVertex)
+                                           : sizeof(QuantizedVertex);
+}
+
+// quantized positions are center + position * scale on each axis, flat axes
+// get a scale of 1 so they don't divide by zero
+inline float meshQuantizeScale(float min, float max) {
+  float half = (max - min) * 0.5f;
+  return half > 0.0f ? half : 1.0f;
+}
+
+#endif
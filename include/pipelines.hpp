@@ -0,0 +1,16 @@
+#ifndef ENGINE_PIPELINES_HPP
+#define ENGINE_PIPELINES_HPP
+
+#include <common.hpp>
+#include <vulkan.hpp>
+
+#endif
+PipelineHandle buildPipeline(const PipelineState& state);
+PipelineHandle requestPipeline(const PipelineState& state,
+                               PipelineHandle fallback);
+PipelineHandle requestViewPipeline(PipelineState state);
+PipelineHandle buildPrepassPipeline(PipelineState state);
+vk::Pipeline currentPipeline(PipelineHandle handle);
+void updatePipelines();
+void waitForPipelines();
+void cleanupPipelines();
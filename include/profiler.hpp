@@ -0,0 +1,42 @@
+#ifndef ENGINE_PROFILER_HPP
+#define ENGINE_PROFILER_HPP
+
+#include <common.hpp>
+
+// times the enclosing scope on the calling thread while profiling is on, the
+// name has to outlive the profiler so in practice it's a string literal
+struct ProfileZone {
+  const char* name;
+  int64_t start;
+
+  explicit ProfileZone(const char* name);
+  ~ProfileZone();
+
+  ProfileZone(const ProfileZone&) = delete;
+  ProfileZone& operator=(const ProfileZone&) = delete;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name)                                                     \
+  ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+// how long a zone took per frame over the last few frames, in milliseconds
+struct ProfileStat {
+  std::string name;
+  bool gpu;
+  double mean;
+  double max;
+};
+
+#endif
+void initProfiler();
+void cleanupProfiler();
+void setProfiling(bool enabled);
+bool profiling();
+uint32_t beginGpuZone(vk::CommandBuffer commandBuffer, const char* name,
+                      uint64_t uploadId = 0);
+void endGpuZone(vk::CommandBuffer commandBuffer, uint32_t zone);
+void profileFrame(uint32_t frame);
+std::vector<ProfileStat> profileSummary();
+bool writeProfileTrace(const std::string& path);
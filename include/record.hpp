@@ -0,0 +1,12 @@
+#ifndef ENGINE_RECORD_HPP
+#define ENGINE_RECORD_HPP
+
+#include <common.hpp>
+#include <jobs.hpp>
+#include <vulkan.hpp>
+
+#endif
+void initRecording();
+void cleanupRecording();
+void recordDraws(vk::CommandBuffer primary, uint32_t imageIndex,
+                 bool prepass);
@@ -0,0 +1,115 @@
+#ifndef ENGINE_RENDERGRAPH_HPP
+#define ENGINE_RENDERGRAPH_HPP
+
+#include <common.hpp>
+#include <vulkan.hpp>
+
+// how a pass uses a resource, each implies the pipeline stages, access and
+// image layout that barriers are built from, the first three only make sense
+// as a resource's initial or final state
+enum class GraphAccess {
+  // nothing happened to it yet, or nothing happens to it afterwards
+  None,
+  // a swapchain image, acquired with a semaphore waited on at color output
+  Acquire,
+  Present,
+  ColorAttachment,
+  DepthAttachment,
+  DepthRead,
+  Sampled,
+  ComputeRead,
+  ComputeWrite,
+  TransferRead,
+  TransferWrite,
+  IndirectRead,
+};
+
+struct GraphUse {
+  uint32_t resource;
+  GraphAccess access;
+};
+
+// imported resources belong to someone else and are bound again every frame,
+// transient images are created by the graph and only live from their first
+// pass to their last, so ones that don't overlap share memory, ones that are
+// only attachments might not get any memory at all
+struct GraphResource {
+  const char* name;
+  bool isImage;
+  bool transient = false;
+  vk::Image image;
+  vk::ImageView view;
+  vk::Buffer buffer;
+
+  // state when the graph starts and when it's done, a final state other than
+  // None makes the resource an output of the graph
+  GraphAccess initial = GraphAccess::None;
+  GraphAccess final = GraphAccess::None;
+
+  // transient images only, memory is the index of the allocation it shares
+  vk::Format format;
+  vk::Extent2D extent;
+  vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+  uint32_t memory;
+};
+
+struct GraphPass {
+  const char* name;
+  std::vector<GraphUse> uses;
+  std::function<void(vk::CommandBuffer)> record;
+  // doesn't contribute to any of the graph's outputs
+  bool culled = false;
+};
+
+struct GraphImageBarrier {
+  uint32_t resource;
+  vk::AccessFlags srcAccess;
+  vk::AccessFlags dstAccess;
+  vk::ImageLayout oldLayout;
+  vk::ImageLayout newLayout;
+};
+
+// every barrier a pass needs batched into one call, only layout transitions
+// get an image barrier of their own, everything else goes into the global
+// memory barrier, the actual images are filled in when the graph is executed
+// since imported ones change every frame
+struct GraphBarrier {
+  vk::PipelineStageFlags srcStage;
+  vk::PipelineStageFlags dstStage;
+  vk::AccessFlags srcAccess;
+  vk::AccessFlags dstAccess;
+  std::vector<GraphImageBarrier> images;
+};
+
+// passes are recorded in the order they were added, compileGraph culls the
+// ones nothing depends on, works out the barriers between the rest and
+// creates the transient images
+struct RenderGraph {
+  std::vector<GraphResource> resources;
+  std::vector<GraphPass> passes;
+  // barriers[i] goes before passes[i], the last one after every pass
+  std::vector<GraphBarrier> barriers;
+  std::vector<VmaAllocation> memory;
+  bool compiled = false;
+};
+
+#endif
+uint32_t importGraphImage(RenderGraph& graph, const char* name,
+                          GraphAccess initial, GraphAccess final);
+uint32_t importGraphBuffer(RenderGraph& graph, const char* name,
+                           GraphAccess initial = GraphAccess::None,
+                           GraphAccess final = GraphAccess::None);
+uint32_t addGraphImage(
+    RenderGraph& graph, const char* name, vk::Format format,
+    vk::Extent2D extent,
+    vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1);
+void addGraphPass(RenderGraph& graph, const char* name,
+                  std::vector<GraphUse> uses,
+                  std::function<void(vk::CommandBuffer)> record);
+void bindGraphImage(RenderGraph& graph, uint32_t resource, vk::Image image,
+                    vk::ImageView view);
+void bindGraphBuffer(RenderGraph& graph, uint32_t resource, vk::Buffer buffer);
+vk::ImageView graphImageView(const RenderGraph& graph, uint32_t resource);
+void compileGraph(RenderGraph& graph);
+void executeGraph(RenderGraph& graph, vk::CommandBuffer commandBuffer);
+void destroyGraph(RenderGraph& graph);
@@ -0,0 +1,26 @@
+#ifndef ENGINE_RESOURCES_HPP
+#define ENGINE_RESOURCES_HPP
+
+#include <common.hpp>
+#include <vulkan.hpp>
+
+#endif
+BufferHandle addBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage,
+                       vk::MemoryPropertyFlags props, VmaMemoryUsage memUsage);
+const GpuBuffer& getBuffer(BufferHandle handle);
+void destroyBuffer(BufferHandle handle);
+ImageHandle addImage(const Texture& texture);
+Texture& getImage(ImageHandle handle);
+void destroyImage(ImageHandle handle);
+SamplerHandle addSampler(const vk::SamplerCreateInfo& info);
+vk::Sampler getSampler(SamplerHandle handle);
+void destroySampler(SamplerHandle handle);
+PipelineHandle addPipeline(vk::Pipeline pipeline);
+vk::Pipeline getPipeline(PipelineHandle handle);
+void destroyPipeline(PipelineHandle handle);
+MeshHandle addMesh(const Mesh& mesh);
+const Mesh& getMesh(MeshHandle handle);
+void destroyMesh(MeshHandle handle);
+void deferDestroy(std::function<void()> destroy);
+void retireResources();
+void cleanupResources();
@@ -0,0 +1,26 @@
+#ifndef ENGINE_SHADERS_HPP
+#define ENGINE_SHADERS_HPP
+
+#include <common.hpp>
+
+// every shader the engine has, compiled into the binary at build time
+enum class Shader {
+  TriangleVert,
+  TriangleFrag,
+  BindlessFrag,
+  CullComp,
+  GpuVert,
+  GpuFrag,
+  InstancedVert,
+  InstancedFrag,
+  InstancedBindlessFrag,
+};
+
+// size is in bytes like vk::ShaderModuleCreateInfo wants it
+struct ShaderCode {
+  const uint32_t* code;
+  size_t size;
+};
+
+#endif
+ShaderCode shaderCode(Shader shader);
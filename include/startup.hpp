@@ -0,0 +1,24 @@
+#ifndef ENGINE_STARTUP_HPP
+#define ENGINE_STARTUP_HPP
+
+#include <common.hpp>
+#include <jobs.hpp>
+
+// one step of startup in milliseconds since launch, job steps ran on the job
+// threads alongside the main thread's
+struct StartupStep {
+  std::string name;
+  double start;
+  double duration;
+  bool job;
+};
+
+#endif
+void startupStep(const char* name, const std::function<void()>& step,
+                 std::initializer_list<JobCounter*> after = {});
+void startupJob(const char* name, Job step, JobCounter& done);
+void preloadFile(const std::string& path);
+std::vector<char> loadFile(const std::string& path);
+void finishStartup();
+double firstFrameTime();
+std::vector<StartupStep> startupSteps();
@@ -0,0 +1,37 @@
+#include <bits/stdc++.h>
+
+#ifndef ENGINE_TEXFILE_HPP
+#define ENGINE_TEXFILE_HPP
+
+// cooked textures are written by texcook and mapped straight into staging by
+// the engine, a file is a TextureFileHeader, then mipLevels TextureFileLevel
+// entries and then the block data of every level, level 0 first
+
+enum class TextureFileFormat : uint32_t {
+  BC1 = 1, // rgb, 8 bytes per 4x4 block
+  BC3 = 2, // rgba, 16 bytes per 4x4 block
+};
+
+struct TextureFileHeader {
+  static constexpr uint32_t MAGIC = 0x58455443; // "CTEX"
+  static constexpr uint32_t VERSION = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  TextureFileFormat format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t mipLevels;
+};
+
+// offsets are from the start of the file and aligned to 16 bytes
+struct TextureFileLevel {
+  uint64_t offset;
+  uint64_t size;
+};
+
+inline uint32_t textureBlockSize(TextureFileFormat format) {
+  return format == TextureFileFormat::BC1 ? 8 : 16;
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef ENGINE_TEXTURES_HPP
+#define ENGINE_TEXTURES_HPP
+
+#include <common.hpp>
+#include <image.hpp>
+#include <jobs.hpp>
+
+#endif
+void initTextures();
+void cleanupTextures();
+ImageHandle loadTexture(const std::string& path);
+void updateTextures();
+const Texture& getTexture(ImageHandle image);
+uint32_t getTextureSlot(ImageHandle image);
+void writeTextureSlot(uint32_t slot, vk::ImageView view);
+void bindTextures(uint32_t frame);
@@ -0,0 +1,20 @@
+#ifndef ENGINE_UPLOAD_HPP
+#define ENGINE_UPLOAD_HPP
+
+#include <common.hpp>
+#include <vulkan.hpp>
+
+#endif
+void initUploads();
+void cleanupUploads();
+void uploadBuffer(vk::Buffer buffer, const void* data, vk::DeviceSize size,
+                  vk::AccessFlags dstAccess, vk::PipelineStageFlags dstStage);
+void uploadImage(vk::Image image, vk::Format format, const void* data,
+                 vk::DeviceSize size, uint32_t width, uint32_t height,
+                 uint32_t mipLevels = 1);
+void uploadImageLevels(vk::Image image, vk::Format format, const void* data,
+                       vk::DeviceSize size, uint32_t width, uint32_t height,
+                       const std::vector<vk::DeviceSize>& levelOffsets);
+uint64_t submitUploads();
+bool uploadsComplete(uint64_t id);
+void waitForUploads(uint64_t id);
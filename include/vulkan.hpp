@@ -1,14 +1,17 @@
 #include <common.hpp>
 #define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <image.hpp>
+#include <shaders.hpp>
 
 #ifndef ENGINE_VULKAN_HPP
 #define ENGINE_VULKAN_HPP
 struct QueueIndices {
   std::optional<uint32_t> graphicsFamily;
   std::optional<uint32_t> presentFamily;
+  std::optional<uint32_t> transferFamily;
 
   inline bool isComplete() {
     return graphicsFamily.has_value() && presentFamily.has_value();
@@ -21,8 +24,48 @@ struct SwapchainSupportDetails {
   std::vector<vk::PresentModeKHR> presentModes;
 };
 
+// how a pipeline uses the depth buffer, prepass pipelines have no fragment
+// shader or color attachment
+enum class DepthMode {
+  TestWrite,
+  Prepass,
+  // only what the prepass left visible, nothing is written
+  Equal,
+};
+
+// everything a graphics pipeline is built from, the rest of the fixed function
+// state is the same for all of them
+struct PipelineState {
+  vk::PipelineLayout layout;
+  // null with dynamic rendering
+  vk::RenderPass renderPass;
+  vk::Format colorFormat;
+  vk::Format depthFormat;
+  DepthMode depth = DepthMode::TestWrite;
+  vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+  Shader vert;
+  Shader frag;
+  // instanced pipelines add the per instance stream as binding 1
+  bool instanced = false;
+  MeshVertexLayout vertexLayout = MeshVertexLayout::Float;
+  ShadingView view = ShadingView::Textured;
+};
+
+// prepended to the driver's pipeline cache data on disk, the driver's own
+// header doesn't include the driver version
+struct PipelineCacheHeader {
+  static constexpr uint32_t MAGIC = 0x31435045; // "EPC1"
+
+  uint32_t magic;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint32_t driverVersion;
+  uint8_t uuid[VK_UUID_SIZE];
+  uint64_t dataSize;
+};
+
 struct Vertex {
-  glm::vec2 pos;
+  glm::vec3 pos;
   glm::vec3 color;
   glm::vec2 texCoord;
 
@@ -38,7 +81,7 @@ struct Vertex {
 
     descriptions[0].binding = 0;
     descriptions[0].location = 0;
-    descriptions[0].format = vk::Format::eR32G32Sfloat;
+    descriptions[0].format = vk::Format::eR32G32B32Sfloat;
     descriptions[0].offset = offsetof(Vertex, pos);
 
     descriptions[1].binding = 0;
@@ -55,16 +98,55 @@ struct Vertex {
   }
 };
 
+// the per instance stream of the instanced path, binding 1
+struct InstanceData {
+  glm::mat4 model;
+  glm::vec4 color;
+  uint32_t textureSlot;
+
+  static vk::VertexInputBindingDescription getBindingDescription() {
+    vk::VertexInputBindingDescription bindingDescription(
+        1, sizeof(InstanceData), vk::VertexInputRate::eInstance);
+
+    return bindingDescription;
+  }
+
+  static std::array<vk::VertexInputAttributeDescription, 6>
+  getAttributeDescription() {
+    std::array<vk::VertexInputAttributeDescription, 6> descriptions;
+
+    // a mat4 takes up four locations, one per column
+    for (uint32_t i = 0; i < 4; i++) {
+      descriptions[i].binding = 1;
+      descriptions[i].location = 3 + i;
+      descriptions[i].format = vk::Format::eR32G32B32A32Sfloat;
+      descriptions[i].offset = offsetof(InstanceData, model) + i * 16;
+    }
+
+    descriptions[4].binding = 1;
+    descriptions[4].location = 7;
+    descriptions[4].format = vk::Format::eR32G32B32A32Sfloat;
+    descriptions[4].offset = offsetof(InstanceData, color);
+
+    descriptions[5].binding = 1;
+    descriptions[5].location = 8;
+    descriptions[5].format = vk::Format::eR32Uint;
+    descriptions[5].offset = offsetof(InstanceData, textureSlot);
+
+    return descriptions;
+  }
+};
+
 struct MVP {
   alignas(16) glm::mat4 model;
   alignas(16) glm::mat4 view;
   alignas(16) glm::mat4 proj;
 };
 const std::vector<Vertex> vertices = {
-    {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
-    {{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
-    {{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
-    {{-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}}};
+    {{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
+    {{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
+    {{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
+    {{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}}};
 
 const std::vector<uint16_t> indices = {0, 1, 2, 2, 3, 0};
 #endif
@@ -72,11 +154,18 @@ vk::Buffer createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage,
                         vk::MemoryPropertyFlags props, VmaMemoryUsage memUsage,
                         VmaAllocation& allocation);
 
-void copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer,
-                vk::DeviceSize size);
+std::vector<char> readFile(const std::string& filename);
+vk::ShaderModule createShaderModule(Shader shader);
+vk::SpecializationInfo
+specializationInfo(const std::vector<uint32_t>& values,
+                   std::vector<vk::SpecializationMapEntry>& entries);
+vk::Pipeline buildGraphicsPipeline(const PipelineState& state);
 
 void initVulkan();
 void cleanupVulkan();
 void drawFrame();
-vk::CommandBuffer beginCommands();
-void endCommands(vk::CommandBuffer& buffer);
+void setPresentPolicy(PresentPolicy policy);
+void setShadingView(ShadingView view);
+uint8_t* allocateUniforms(vk::DeviceSize size, uint32_t& offset);
+uint32_t pushUniforms(const void* data, vk::DeviceSize size);
+void flushTimestamps();
@@ -0,0 +1,24 @@
+#version 450
+#extension GL_ARB_separate_shader_objects: enable
+#extension GL_EXT_nonuniform_qualifier: enable
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragTextureSlot;
+
+layout(location = 0) out vec4 outColor;
+
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(constant_id = 0) const uint VIEW = 0;
+
+void main() {
+  if (VIEW == 1) {
+    outColor = vec4(fragColor, 1.0);
+  } else if (VIEW == 2) {
+    outColor = vec4(fragTexCoord, 0.0, 1.0);
+  } else {
+    // draws of one indirect call can share a subgroup
+    outColor = texture(textures[nonuniformEXT(fragTextureSlot)], fragTexCoord);
+  }
+}
@@ -0,0 +1,40 @@
+#version 450
+
+// the depth prepass runs the same vertex shader and the main pass tests for
+// equal depth, so positions have to come out bit for bit the same
+invariant gl_Position;
+
+struct Object {
+  mat4 model;
+  vec4 sphere;
+  uint indexCount;
+  uint firstIndex;
+  int vertexOffset;
+  uint textureSlot;
+};
+
+layout(set = 0, binding = 0) readonly buffer Objects {
+  Object objects[];
+};
+
+layout(push_constant) uniform View {
+  mat4 viewProj;
+} view;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragTextureSlot;
+
+void main() {
+    // the culling shader stores the object index in firstInstance
+    Object object = objects[gl_InstanceIndex];
+
+    gl_Position = view.viewProj * object.model * vec4(inPosition, 1.0);
+    fragColor = inColor;
+    fragTexCoord = inTexCoord;
+    fragTextureSlot = object.textureSlot;
+}
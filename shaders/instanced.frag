@@ -0,0 +1,23 @@
+#version 450
+#extension GL_ARB_separate_shader_objects: enable
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in vec4 fragTint;
+layout(location = 3) flat in uint fragTextureSlot;
+
+layout(location = 0) out vec4 outColor;
+
+layout(binding = 1) uniform sampler2D texSampler;
+
+// the debug views leave out the tint
+layout(constant_id = 0) const uint VIEW = 0;
+
+void main() {
+  if (VIEW == 1)
+    outColor = vec4(fragColor, 1.0);
+  else if (VIEW == 2)
+    outColor = vec4(fragTexCoord, 0.0, 1.0);
+  else
+    outColor = texture(texSampler, fragTexCoord) * fragTint;
+}
@@ -0,0 +1,32 @@
+#version 450
+
+// has to match the depth prepass exactly for the equal test
+invariant gl_Position;
+
+// model is the identity, every instance brings its own
+layout(binding = 0) uniform MVP {
+  mat4 model;
+  mat4 view;
+  mat4 proj;
+} mvp;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(location = 3) in mat4 instanceModel;
+layout(location = 7) in vec4 instanceColor;
+layout(location = 8) in uint instanceTextureSlot;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out vec4 fragTint;
+layout(location = 3) flat out uint fragTextureSlot;
+
+void main() {
+    gl_Position = mvp.proj * mvp.view * instanceModel * vec4(inPosition, 1.0);
+    fragColor = inColor;
+    fragTexCoord = inTexCoord;
+    fragTint = instanceColor;
+    fragTextureSlot = instanceTextureSlot;
+}
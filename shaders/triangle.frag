@@ -8,6 +8,15 @@ layout(location = 0) out vec4 outColor;
 
 layout(binding = 1) uniform sampler2D texSampler;
 
+// ShadingView, fixed when the pipeline is built so the unused cases are
+// compiled out
+layout(constant_id = 0) const uint VIEW = 0;
+
 void main() {
-  outColor = texture(texSampler, fragTexCoord);
+  if (VIEW == 1)
+    outColor = vec4(fragColor, 1.0);
+  else if (VIEW == 2)
+    outColor = vec4(fragTexCoord, 0.0, 1.0);
+  else
+    outColor = texture(texSampler, fragTexCoord);
 }
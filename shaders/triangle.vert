@@ -1,12 +1,15 @@
 #version 450
 
+// the prepass and the main pass have to agree on depth exactly
+invariant gl_Position;
+
 layout(binding = 0) uniform MVP {
   mat4 model;
   mat4 view;
   mat4 proj;
 } mvp;
 
-layout(location = 0) in vec2 inPosition;
+layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 
@@ -14,7 +17,7 @@ layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
 void main() {
-    gl_Position = mvp.proj * mvp.view * mvp.model * vec4(inPosition, 0.0, 1.0);
+    gl_Position = mvp.proj * mvp.view * mvp.model * vec4(inPosition, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
 }
@@ -0,0 +1,181 @@
+#include <main.hpp>
+#include <profiler.hpp>
+#include <startup.hpp>
+#include <vulkan.hpp>
+
+VulkanContext vkctx;
+
+static double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty())
+    return 0.0;
+
+  size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+static void printStats(const char* name, std::vector<double> samples,
+                       bool last) {
+  std::sort(samples.begin(), samples.end());
+
+  double mean = 0.0;
+  for (double sample : samples)
+    mean += sample;
+  if (!samples.empty())
+    mean /= samples.size();
+
+  std::cout << "  \"" << name << "\": {";
+  std::cout << "\"samples\": " << samples.size() << ", ";
+  std::cout << "\"min\": " << (samples.empty() ? 0.0 : samples.front())
+            << ", ";
+  std::cout << "\"mean\": " << mean << ", ";
+  std::cout << "\"p50\": " << percentile(samples, 0.50) << ", ";
+  std::cout << "\"p90\": " << percentile(samples, 0.90) << ", ";
+  std::cout << "\"p99\": " << percentile(samples, 0.99) << ", ";
+  std::cout << "\"max\": " << (samples.empty() ? 0.0 : samples.back());
+  std::cout << "}" << (last ? "" : ",") << std::endl;
+}
+
+// renders frames without a window and prints cpu and gpu frame times in
+// milliseconds as json, with ENGINE_PROFILE set the profiler's zones too,
+// usage: bench [frames] [warmup frames] [draws] [draws|instanced|gpu]
+//              [frames in flight] [fps limit] [dynamic|render-pass]
+//              [prepass|no-prepass] [msaa 1|2|4|8|16]
+// the path is the fastest one to try, slower ones are used if it's missing,
+// the same goes for dynamic rendering and the msaa sample count, overdraw is
+// fragment shader invocations per pixel in the main pass if the device can
+// count them
+int main(int argc, char** argv) {
+  uint32_t frames = argc > 1 ? std::stoul(argv[1]) : 1000;
+  uint32_t warmup = argc > 2 ? std::stoul(argv[2]) : 100;
+
+  vkctx.drawCount = argc > 3 ? std::stoul(argv[3]) : 1;
+  std::string path = argc > 4 ? argv[4] : "gpu";
+  if (path == "draws") {
+    vkctx.allowGpuDriven = false;
+    vkctx.instanced = false;
+  } else if (path == "instanced") {
+    vkctx.allowGpuDriven = false;
+  } else if (path != "gpu") {
+    std::cerr << "unknown path " << path << std::endl;
+    return 1;
+  }
+
+  if (argc > 5)
+    vkctx.framesInFlight = std::stoul(argv[5]);
+  if (argc > 6 && std::stod(argv[6]) > 0.0)
+    vkctx.targetFrameTime = 1000.0 / std::stod(argv[6]);
+
+  std::string rendering = argc > 7 ? argv[7] : "dynamic";
+  if (rendering == "render-pass") {
+    vkctx.allowDynamicRendering = false;
+  } else if (rendering != "dynamic") {
+    std::cerr << "unknown rendering " << rendering << std::endl;
+    return 1;
+  }
+
+  std::string prepass = argc > 8 ? argv[8] : "no-prepass";
+  if (prepass == "prepass") {
+    vkctx.depthPrepass = true;
+  } else if (prepass != "no-prepass") {
+    std::cerr << "unknown prepass " << prepass << std::endl;
+    return 1;
+  }
+
+  vkctx.msaa = argc > 9 ? std::stoul(argv[9]) : 1;
+  if (vkctx.msaa == 0 || vkctx.msaa > 16 ||
+      (vkctx.msaa & (vkctx.msaa - 1)) != 0) {
+    std::cerr << "unsupported msaa " << vkctx.msaa << std::endl;
+    return 1;
+  }
+
+  vkctx.headless = true;
+  vkctx.timestamps = true;
+  vkctx.overdrawStats = true;
+  initVulkan();
+
+  for (uint32_t i = 0; i < warmup; i++)
+    drawFrame();
+  vkctx.device.waitIdle();
+  flushTimestamps();
+  vkctx.gpuFrameTimes.clear();
+  vkctx.overdraw.clear();
+
+  std::vector<double> cpuFrameTimes;
+  cpuFrameTimes.reserve(frames);
+
+  auto benchStart = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < frames; i++) {
+    auto start = std::chrono::steady_clock::now();
+    drawFrame();
+    auto end = std::chrono::steady_clock::now();
+    cpuFrameTimes.push_back(
+        std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  vkctx.device.waitIdle();
+  auto benchEnd = std::chrono::steady_clock::now();
+  flushTimestamps();
+
+  double total =
+      std::chrono::duration<double, std::milli>(benchEnd - benchStart).count();
+  auto props = vkctx.physicalDevice.getProperties();
+
+  std::cout << std::fixed << std::setprecision(4);
+  std::cout << "{" << std::endl;
+  std::cout << "  \"device\": \"" << std::string(props.deviceName) << "\","
+            << std::endl;
+  std::cout << "  \"width\": " << vkctx.swapchainExtent.width << ","
+            << std::endl;
+  std::cout << "  \"height\": " << vkctx.swapchainExtent.height << ","
+            << std::endl;
+  std::cout << "  \"frames\": " << frames << "," << std::endl;
+  std::cout << "  \"draws\": " << vkctx.drawCount << "," << std::endl;
+  std::cout << "  \"record_threads\": " << vkctx.recordThreads << ","
+            << std::endl;
+  std::cout << "  \"frames_in_flight\": " << vkctx.framesInFlight << ","
+            << std::endl;
+  const char* renderPath =
+      vkctx.gpuDriven ? "gpu" : vkctx.instanced ? "instanced" : "draws";
+  std::cout << "  \"path\": \"" << renderPath << "\"," << std::endl;
+  std::cout << "  \"dynamic_rendering\": "
+            << (vkctx.dynamicRendering ? "true" : "false") << "," << std::endl;
+  std::cout << "  \"depth_prepass\": "
+            << (vkctx.depthPrepass ? "true" : "false") << "," << std::endl;
+  std::cout << "  \"msaa\": " << static_cast<uint32_t>(vkctx.samples) << ","
+            << std::endl;
+  std::cout << "  \"total_ms\": " << total << "," << std::endl;
+  std::cout << "  \"first_frame_ms\": " << firstFrameTime() << ","
+            << std::endl;
+  auto steps = startupSteps();
+  std::cout << "  \"startup\": [" << std::endl;
+  for (size_t i = 0; i < steps.size(); i++) {
+    std::cout << "    {\"name\": \"" << steps[i].name
+              << "\", \"start_ms\": " << steps[i].start
+              << ", \"ms\": " << steps[i].duration << ", \"job\": "
+              << (steps[i].job ? "true" : "false") << "}"
+              << (i + 1 < steps.size() ? "," : "") << std::endl;
+  }
+  std::cout << "  ]," << std::endl;
+  if (vkctx.pipelineFeedback)
+    std::cout << "  \"pipeline_cache\": {\"hits\": " << vkctx.pipelineCacheHits
+              << ", \"misses\": " << vkctx.pipelineCacheMisses << "},"
+              << std::endl;
+  printStats("cpu_ms", cpuFrameTimes, false);
+  printStats("overdraw", vkctx.overdraw, false);
+  printStats("gpu_ms", vkctx.gpuFrameTimes, !profiling());
+  if (profiling()) {
+    auto summary = profileSummary();
+    std::cout << "  \"zones\": [" << std::endl;
+    for (size_t i = 0; i < summary.size(); i++) {
+      const auto& stat = summary[i];
+      std::cout << "    {\"name\": \"" << stat.name << "\", \"gpu\": "
+                << (stat.gpu ? "true" : "false")
+                << ", \"mean_ms\": " << stat.mean
+                << ", \"max_ms\": " << stat.max << "}"
+                << (i + 1 < summary.size() ? "," : "") << std::endl;
+    }
+    std::cout << "  ]" << std::endl;
+  }
+  std::cout << "}" << std::endl;
+
+  cleanupVulkan();
+}
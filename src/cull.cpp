@@ -0,0 +1,271 @@
+#include <cull.hpp>
+#include <pipelines.hpp>
+#include <resources.hpp>
+
+// the indirect buffer starts with the draw count, padded to 16 bytes, and is
+// followed by the draws that survived culling
+static const vk::DeviceSize DRAWS_OFFSET = 16;
+
+// set by setCullView for the frame being recorded
+static CullConstants cullConstants;
+static glm::mat4 cullViewProj;
+
+static void createCullBuffers() {
+  uint32_t objectCount = std::max<uint32_t>(vkctx.drawCount, 1);
+  vk::DeviceSize objectSize = sizeof(GpuObject) * objectCount;
+  vk::DeviceSize indirectSize =
+      DRAWS_OFFSET + sizeof(vk::DrawIndexedIndirectCommand) * objectCount;
+
+  vkctx.objectBuffers.resize(vkctx.framesInFlight);
+  vkctx.objectAllocations.resize(vkctx.framesInFlight);
+  vkctx.objectData.resize(vkctx.framesInFlight);
+  vkctx.indirectBuffers.resize(vkctx.framesInFlight);
+  vkctx.indirectAllocations.resize(vkctx.framesInFlight);
+
+  for (uint32_t i = 0; i < vkctx.framesInFlight; i++) {
+    // written by the cpu every frame, mapped once like the uniform arenas
+    vkctx.objectBuffers[i] =
+        createBuffer(objectSize, vk::BufferUsageFlagBits::eStorageBuffer,
+                     vk::MemoryPropertyFlagBits::eHostVisible |
+                         vk::MemoryPropertyFlagBits::eHostCoherent,
+                     VMA_MEMORY_USAGE_CPU_TO_GPU, vkctx.objectAllocations[i]);
+
+    void* data;
+    vmaMapMemory(vkctx.allocator, vkctx.objectAllocations[i], &data);
+    vkctx.objectData[i] = static_cast<uint8_t*>(data);
+
+    vkctx.indirectBuffers[i] =
+        createBuffer(indirectSize,
+                     vk::BufferUsageFlagBits::eStorageBuffer |
+                         vk::BufferUsageFlagBits::eIndirectBuffer |
+                         vk::BufferUsageFlagBits::eTransferDst,
+                     vk::MemoryPropertyFlagBits::eDeviceLocal,
+                     VMA_MEMORY_USAGE_GPU_ONLY, vkctx.indirectAllocations[i]);
+  }
+}
+
+static void createCullDescriptors() {
+  std::array<vk::DescriptorSetLayoutBinding, 2> bindings;
+  bindings[0] = vk::DescriptorSetLayoutBinding(
+      0, vk::DescriptorType::eStorageBuffer, 1,
+      vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute);
+  bindings[1] = vk::DescriptorSetLayoutBinding(
+      1, vk::DescriptorType::eStorageBuffer, 1,
+      vk::ShaderStageFlagBits::eCompute);
+
+  vk::DescriptorSetLayoutCreateInfo layoutInfo(
+      {}, static_cast<uint32_t>(bindings.size()), bindings.data());
+  vkctx.cullLayout = vkctx.device.createDescriptorSetLayout(layoutInfo);
+
+  vk::DescriptorPoolSize poolSize(vk::DescriptorType::eStorageBuffer,
+                                  vkctx.framesInFlight * 2);
+  vk::DescriptorPoolCreateInfo poolInfo({}, vkctx.framesInFlight, 1,
+                                        &poolSize);
+  vkctx.cullPool = vkctx.device.createDescriptorPool(poolInfo);
+
+  std::vector<vk::DescriptorSetLayout> layouts(vkctx.framesInFlight,
+                                               vkctx.cullLayout);
+  vk::DescriptorSetAllocateInfo allocInfo(
+      vkctx.cullPool, static_cast<uint32_t>(layouts.size()), layouts.data());
+  vkctx.cullSets = vkctx.device.allocateDescriptorSets(allocInfo);
+
+  for (size_t i = 0; i < layouts.size(); i++) {
+    vk::DescriptorBufferInfo objectInfo(vkctx.objectBuffers[i], 0,
+                                        VK_WHOLE_SIZE);
+    vk::DescriptorBufferInfo indirectInfo(vkctx.indirectBuffers[i], 0,
+                                          VK_WHOLE_SIZE);
+
+    std::array<vk::WriteDescriptorSet, 2> writes;
+    writes[0] = vk::WriteDescriptorSet(vkctx.cullSets[i], 0, 0, 1,
+                                       vk::DescriptorType::eStorageBuffer,
+                                       nullptr, &objectInfo, nullptr);
+    writes[1] = vk::WriteDescriptorSet(vkctx.cullSets[i], 1, 0, 1,
+                                       vk::DescriptorType::eStorageBuffer,
+                                       nullptr, &indirectInfo, nullptr);
+    vkctx.device.updateDescriptorSets(static_cast<uint32_t>(writes.size()),
+                                      writes.data(), 0, nullptr);
+  }
+}
+
+static void createCullPipelines() {
+  vk::PushConstantRange cullRange(vk::ShaderStageFlagBits::eCompute, 0,
+                                  sizeof(CullConstants));
+  vk::PipelineLayoutCreateInfo cullLayoutInfo({}, 1, &vkctx.cullLayout, 1,
+                                              &cullRange);
+  vkctx.cullPipelineLayout =
+      vkctx.device.createPipelineLayout(cullLayoutInfo);
+
+  auto module = createShaderModule(Shader::CullComp);
+
+  // the workgroup size is specialized so the dispatch can't disagree with it
+  std::vector<uint32_t> constants = {vkctx.CULL_GROUP_SIZE};
+  std::vector<vk::SpecializationMapEntry> entries;
+  vk::SpecializationInfo specialization =
+      specializationInfo(constants, entries);
+
+  vk::ComputePipelineCreateInfo pipelineInfo(
+      {},
+      vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute,
+                                        module, "main", &specialization),
+      vkctx.cullPipelineLayout);
+  vkctx.cullPipeline = addPipeline(
+      vkctx.device.createComputePipeline(vkctx.pipelineCache, pipelineInfo));
+
+  vkctx.device.destroyShaderModule(module);
+
+  // objects come from set 0 and textures from the bindless set 1
+  std::array<vk::DescriptorSetLayout, 2> setLayouts = {vkctx.cullLayout,
+                                                       vkctx.textureLayout};
+  vk::PushConstantRange viewRange(vk::ShaderStageFlagBits::eVertex, 0,
+                                  sizeof(glm::mat4));
+  vk::PipelineLayoutCreateInfo gpuLayoutInfo(
+      {}, static_cast<uint32_t>(setLayouts.size()), setLayouts.data(), 1,
+      &viewRange);
+  vkctx.gpuPipelineLayout = vkctx.device.createPipelineLayout(gpuLayoutInfo);
+
+  requestGpuPipeline();
+}
+
+// built on a job unless it's the textured one, like the scene pipelines
+void requestGpuPipeline() {
+  PipelineState state;
+  state.layout = vkctx.gpuPipelineLayout;
+  state.renderPass = vkctx.renderPass;
+  state.colorFormat = vkctx.swapchainImageFormat;
+  state.depthFormat = vkctx.depthFormat;
+  state.depth = vkctx.depthPrepass ? DepthMode::Equal : DepthMode::TestWrite;
+  state.samples = vkctx.samples;
+  state.vert = Shader::GpuVert;
+  state.frag = Shader::GpuFrag;
+  state.vertexLayout = getMesh(vkctx.sceneMesh).layout;
+  vkctx.gpuPipeline = requestViewPipeline(state);
+
+  if (vkctx.depthPrepass)
+    vkctx.gpuPrepassPipeline = buildPrepassPipeline(state);
+}
+
+void initCulling() {
+  // extension commands aren't exported by the loader
+  vkctx.drawIndexedIndirectCount =
+      reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+          vkctx.device.getProcAddr("vkCmdDrawIndexedIndirectCountKHR"));
+  if (!vkctx.drawIndexedIndirectCount)
+    throw std::runtime_error("can't load vkCmdDrawIndexedIndirectCountKHR");
+
+  createCullBuffers();
+  createCullDescriptors();
+  createCullPipelines();
+}
+
+void cleanupCulling() {
+  vkctx.device.destroyPipelineLayout(vkctx.gpuPipelineLayout);
+  destroyPipeline(vkctx.cullPipeline);
+  vkctx.device.destroyPipelineLayout(vkctx.cullPipelineLayout);
+  vkctx.device.destroyDescriptorPool(vkctx.cullPool);
+  vkctx.device.destroyDescriptorSetLayout(vkctx.cullLayout);
+
+  for (uint32_t i = 0; i < vkctx.objectBuffers.size(); i++) {
+    vmaUnmapMemory(vkctx.allocator, vkctx.objectAllocations[i]);
+    vmaDestroyBuffer(vkctx.allocator, vkctx.objectBuffers[i],
+                     vkctx.objectAllocations[i]);
+    vmaDestroyBuffer(vkctx.allocator, vkctx.indirectBuffers[i],
+                     vkctx.indirectAllocations[i]);
+  }
+  vkctx.objectBuffers.clear();
+  vkctx.objectAllocations.clear();
+  vkctx.objectData.clear();
+  vkctx.indirectBuffers.clear();
+  vkctx.indirectAllocations.clear();
+}
+
+// drawCount objects for the current frame, safe to write once its fence has
+// signalled
+GpuObject* frameObjects() {
+  return reinterpret_cast<GpuObject*>(vkctx.objectData[vkctx.currentFrame]);
+}
+
+// extracts the frustum planes from the view projection matrix, vulkan's clip
+// space z runs from 0 to w
+void setCullView(const glm::mat4& viewProj) {
+  glm::vec4 rows[4];
+  for (int i = 0; i < 4; i++)
+    rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i],
+                        viewProj[3][i]);
+
+  cullConstants.planes[0] = rows[3] + rows[0];
+  cullConstants.planes[1] = rows[3] - rows[0];
+  cullConstants.planes[2] = rows[3] + rows[1];
+  cullConstants.planes[3] = rows[3] - rows[1];
+  cullConstants.planes[4] = rows[2];
+  cullConstants.planes[5] = rows[3] - rows[2];
+
+  // normalized so the distance can be compared to the sphere's radius
+  for (auto& plane : cullConstants.planes)
+    plane /= glm::length(glm::vec3(plane));
+
+  cullConstants.objectCount = vkctx.drawCount;
+  cullViewProj = viewProj;
+}
+
+// the culling shader counts the draws it keeps from zero
+void clearDrawCount(vk::CommandBuffer commandBuffer) {
+  commandBuffer.fillBuffer(vkctx.indirectBuffers[vkctx.currentFrame], 0,
+                           sizeof(uint32_t), 0);
+}
+
+// has to be recorded outside the render pass, after clearDrawCount, the
+// render graph puts the barriers around it
+void recordCulling(vk::CommandBuffer commandBuffer) {
+  commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute,
+                             getPipeline(vkctx.cullPipeline));
+  commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                   vkctx.cullPipelineLayout, 0, 1,
+                                   &vkctx.cullSets[vkctx.currentFrame], 0,
+                                   nullptr);
+  commandBuffer.pushConstants(vkctx.cullPipelineLayout,
+                              vk::ShaderStageFlagBits::eCompute, 0,
+                              sizeof(CullConstants), &cullConstants);
+  uint32_t groupSize = vkctx.CULL_GROUP_SIZE;
+  commandBuffer.dispatch((vkctx.drawCount + groupSize - 1) / groupSize, 1, 1);
+}
+
+// has to be recorded inline in the render pass, the cpu cost doesn't depend on
+// the number of objects, the prepass draws the same list depth only
+void recordIndirectDraws(vk::CommandBuffer commandBuffer, bool prepass) {
+  const auto& indirect = vkctx.indirectBuffers[vkctx.currentFrame];
+  const Mesh& mesh = getMesh(vkctx.sceneMesh);
+
+  commandBuffer.bindPipeline(
+      vk::PipelineBindPoint::eGraphics,
+      currentPipeline(prepass ? vkctx.gpuPrepassPipeline : vkctx.gpuPipeline));
+
+  vk::Viewport viewport(0.0f, 0.0f,
+                        static_cast<float>(vkctx.swapchainExtent.width),
+                        static_cast<float>(vkctx.swapchainExtent.height),
+                        0.0f, 1.0f);
+  vk::Rect2D scissor({0, 0}, vkctx.swapchainExtent);
+
+  commandBuffer.setScissor(0, 1, &scissor);
+  commandBuffer.setViewport(0, 1, &viewport);
+  commandBuffer.bindVertexBuffers(
+      0, std::array<vk::Buffer, 1>({getBuffer(mesh.vertexBuffer).buffer}),
+      {0});
+  commandBuffer.bindIndexBuffer(getBuffer(mesh.indexBuffer).buffer, 0,
+                                mesh.indexType);
+
+  std::array<vk::DescriptorSet, 2> sets = {vkctx.cullSets[vkctx.currentFrame],
+                                           vkctx.textureSet};
+  commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                                   vkctx.gpuPipelineLayout, 0,
+                                   static_cast<uint32_t>(sets.size()),
+                                   sets.data(), 0, nullptr);
+  commandBuffer.pushConstants(vkctx.gpuPipelineLayout,
+                              vk::ShaderStageFlagBits::eVertex, 0,
+                              sizeof(glm::mat4), &cullViewProj);
+
+  vkctx.drawIndexedIndirectCount(
+      static_cast<VkCommandBuffer>(commandBuffer),
+      static_cast<VkBuffer>(indirect), DRAWS_OFFSET,
+      static_cast<VkBuffer>(indirect), 0, vkctx.drawCount,
+      sizeof(vk::DrawIndexedIndirectCommand));
+}
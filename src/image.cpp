@@ -1,15 +1,21 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <image.hpp>
+#include <upload.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 vk::Image createImage(uint32_t width, uint32_t height, vk::Format format,
                       vk::ImageTiling tiling, vk::ImageUsageFlags usage,
-                      vk::MemoryPropertyFlags props,
-                      VmaAllocation& allocation) {
+                      vk::MemoryPropertyFlags props, VmaAllocation& allocation,
+                      uint32_t mipLevels) {
   vk::ImageCreateInfo imageInfo({}, vk::ImageType::e2D, format,
                                 vk::Extent3D(static_cast<uint32_t>(width),
                                              static_cast<uint32_t>(height), 1),
-                                1, 1, vk::SampleCountFlagBits::e1, tiling,
-                                usage, vk::SharingMode::eExclusive);
+                                mipLevels, 1, vk::SampleCountFlagBits::e1,
+                                tiling, usage, vk::SharingMode::eExclusive);
 
   VmaAllocationCreateInfo imageAllocInfo = {};
   imageAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
@@ -25,109 +31,303 @@ vk::Image createImage(uint32_t width, uint32_t height, vk::Format format,
   return output;
 }
 
-void copyBufferToImage(vk::Buffer buffer, vk::Image image, uint32_t width,
-                       uint32_t height) {
-  vk::CommandBuffer commandBuffer = beginCommands();
-
-  vk::BufferImageCopy region(
-      0, 0, 0,
-      vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
-      {0, 0, 0}, {width, height, 1});
-
-  commandBuffer.copyBufferToImage(
-      buffer, image, vk::ImageLayout::eTransferDstOptimal, 1, &region);
-
-  endCommands(commandBuffer);
+// the stages and accesses that use an image in layout, which are what a
+// transition out of it waits for and a transition into it blocks
+static void layoutAccess(vk::ImageLayout layout, vk::PipelineStageFlags& stage,
+                         vk::AccessFlags& access) {
+  switch (layout) {
+  case vk::ImageLayout::eUndefined:
+    stage = vk::PipelineStageFlagBits::eTopOfPipe;
+    access = static_cast<vk::AccessFlags>(0);
+    break;
+  case vk::ImageLayout::eTransferDstOptimal:
+    stage = vk::PipelineStageFlagBits::eTransfer;
+    access = vk::AccessFlagBits::eTransferWrite;
+    break;
+  case vk::ImageLayout::eTransferSrcOptimal:
+    stage = vk::PipelineStageFlagBits::eTransfer;
+    access = vk::AccessFlagBits::eTransferRead;
+    break;
+  case vk::ImageLayout::eShaderReadOnlyOptimal:
+    stage = vk::PipelineStageFlagBits::eFragmentShader;
+    access = vk::AccessFlagBits::eShaderRead;
+    break;
+  case vk::ImageLayout::eColorAttachmentOptimal:
+    stage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+    access = vk::AccessFlagBits::eColorAttachmentRead |
+             vk::AccessFlagBits::eColorAttachmentWrite;
+    break;
+  case vk::ImageLayout::eGeneral:
+    stage = vk::PipelineStageFlagBits::eAllCommands;
+    access = vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+    break;
+  case vk::ImageLayout::ePresentSrcKHR:
+    stage = vk::PipelineStageFlagBits::eBottomOfPipe;
+    access = static_cast<vk::AccessFlags>(0);
+    break;
+  default:
+    throw std::invalid_argument("unsupported layout transition");
+  }
 }
 
-void transitiionImageLayout(vk::Image image, vk::Format format,
-                            vk::ImageLayout oldLayout,
-                            vk::ImageLayout newLayout) {
-  vk::CommandBuffer commandBuffer = beginCommands();
-
+// transitions levelCount mip levels starting at baseMipLevel, frame
+// attachments are transitioned by the render graph instead
+void transitiionImageLayout(vk::CommandBuffer commandBuffer, vk::Image image,
+                            vk::Format, vk::ImageLayout oldLayout,
+                            vk::ImageLayout newLayout, uint32_t baseMipLevel,
+                            uint32_t levelCount) {
   vk::PipelineStageFlags srcStage, dstStage;
+  vk::AccessFlags srcAccess, dstAccess;
+  layoutAccess(oldLayout, srcStage, srcAccess);
+  layoutAccess(newLayout, dstStage, dstAccess);
 
   vk::ImageMemoryBarrier barrier(
-      static_cast<vk::AccessFlags>(0), static_cast<vk::AccessFlags>(0),
-      oldLayout, newLayout, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
-      image,
-      vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
-
-  if (oldLayout == vk::ImageLayout::eUndefined &&
-      newLayout == vk::ImageLayout::eTransferDstOptimal) {
-    barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-
-    srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
-    dstStage = vk::PipelineStageFlagBits::eTransfer;
-  } else if (oldLayout == vk::ImageLayout::eTransferDstOptimal &&
-             newLayout == vk::ImageLayout::eShaderReadOnlyOptimal) {
-    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-
-    srcStage = vk::PipelineStageFlagBits::eTransfer;
-    dstStage = vk::PipelineStageFlagBits::eFragmentShader;
-  } else {
-    throw std::invalid_argument("unsupported layout transition");
-  }
+      srcAccess, dstAccess, oldLayout, newLayout, VK_QUEUE_FAMILY_IGNORED,
+      VK_QUEUE_FAMILY_IGNORED, image,
+      vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, baseMipLevel,
+                                levelCount, 0, 1));
 
   commandBuffer.pipelineBarrier(srcStage, dstStage,
                                 static_cast<vk::DependencyFlags>(0), 0, nullptr,
                                 0, nullptr, 1, &barrier);
+}
+
+uint32_t mipLevelCount(uint32_t width, uint32_t height) {
+  return static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) +
+         1;
+}
+
+// blitting needs linear filtering and blit support for the format, without it
+// textures only get their base level
+bool canGenerateMipmaps(vk::Format format) {
+  auto features =
+      vkctx.physicalDevice.getFormatProperties(format).optimalTilingFeatures;
+
+  return (features & vk::FormatFeatureFlagBits::eBlitSrc) &&
+         (features & vk::FormatFeatureFlagBits::eBlitDst) &&
+         (features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear);
+}
+
+// expects every level in eTransferDstOptimal with level 0 filled in, each
+// level is blitted down from the one above it and all of them end up in
+// eShaderReadOnlyOptimal, needs a graphics queue
+void generateMipmaps(vk::CommandBuffer commandBuffer, vk::Image image,
+                     vk::Format format, uint32_t width, uint32_t height,
+                     uint32_t mipLevels) {
+  int32_t mipWidth = static_cast<int32_t>(width);
+  int32_t mipHeight = static_cast<int32_t>(height);
 
-  endCommands(commandBuffer);
+  for (uint32_t i = 1; i < mipLevels; i++) {
+    transitiionImageLayout(commandBuffer, image, format,
+                           vk::ImageLayout::eTransferDstOptimal,
+                           vk::ImageLayout::eTransferSrcOptimal, i - 1, 1);
+
+    int32_t nextWidth = std::max(mipWidth / 2, 1);
+    int32_t nextHeight = std::max(mipHeight / 2, 1);
+
+    vk::ImageBlit blit(
+        vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i - 1, 0,
+                                   1),
+        {vk::Offset3D(0, 0, 0), vk::Offset3D(mipWidth, mipHeight, 1)},
+        vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i, 0, 1),
+        {vk::Offset3D(0, 0, 0), vk::Offset3D(nextWidth, nextHeight, 1)});
+
+    commandBuffer.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image,
+                            vk::ImageLayout::eTransferDstOptimal, 1, &blit,
+                            vk::Filter::eLinear);
+
+    transitiionImageLayout(commandBuffer, image, format,
+                           vk::ImageLayout::eTransferSrcOptimal,
+                           vk::ImageLayout::eShaderReadOnlyOptimal, i - 1, 1);
+
+    mipWidth = nextWidth;
+    mipHeight = nextHeight;
+  }
+
+  transitiionImageLayout(commandBuffer, image, format,
+                         vk::ImageLayout::eTransferDstOptimal,
+                         vk::ImageLayout::eShaderReadOnlyOptimal,
+                         mipLevels - 1, 1);
 }
 
-void createTextureImage() {
-  int texWidth, texHeight, texChannels;
-  stbi_uc* pixels = stbi_load("textures/img.png", &texWidth, &texHeight,
-                              &texChannels, STBI_rgb_alpha);
-  vk::DeviceSize imageSize = texWidth * texHeight * 4;
+// doesn't touch vulkan so it can run on any thread
+DecodedImage decodeImage(const char* path) {
+  DecodedImage image;
+  int channels;
+  image.pixels =
+      stbi_load(path, &image.width, &image.height, &channels, STBI_rgb_alpha);
 
-  if (!pixels)
+  if (!image.pixels)
     throw std::runtime_error("failed to load image");
 
-  VmaAllocation stagingAllocation;
-  vk::Buffer stagingBuffer =
-      createBuffer(imageSize, vk::BufferUsageFlagBits::eTransferSrc,
-                   vk::MemoryPropertyFlagBits::eHostVisible |
-                       vk::MemoryPropertyFlagBits::eHostCoherent,
-                   VMA_MEMORY_USAGE_CPU_ONLY, stagingAllocation);
-
-  VmaAllocationInfo allocInfo;
-  vmaGetAllocationInfo(vkctx.allocator, stagingAllocation, &allocInfo);
-
-  void* data = vkctx.device.mapMemory(allocInfo.deviceMemory, allocInfo.offset,
-                                      imageSize);
-  SDL_memcpy(data, pixels, static_cast<size_t>(imageSize));
-  vkctx.device.unmapMemory(allocInfo.deviceMemory);
-  stbi_image_free(pixels);
-
-  vkctx.textureImage = createImage(
-      texWidth, texHeight, vk::Format::eR8G8B8A8Unorm,
-      vk::ImageTiling::eOptimal,
+  return image;
+}
+
+// the pixels are copied to staging, the caller still owns them
+Texture createTexture(const DecodedImage& image) {
+  vk::DeviceSize imageSize = image.width * image.height * 4;
+  uint32_t width = static_cast<uint32_t>(image.width);
+  uint32_t height = static_cast<uint32_t>(image.height);
+
+  Texture texture;
+  texture.format = vk::Format::eR8G8B8A8Unorm;
+  if (canGenerateMipmaps(texture.format))
+    texture.mipLevels = mipLevelCount(width, height);
+  else
+    std::cerr << "can't blit textures, skipping mipmaps" << std::endl;
+
+  // the base level is read back to blit the rest of the chain
+  texture.image = createImage(
+      width, height, texture.format, vk::ImageTiling::eOptimal,
+      vk::ImageUsageFlagBits::eTransferSrc |
+          vk::ImageUsageFlagBits::eTransferDst |
+          vk::ImageUsageFlagBits::eSampled,
+      vk::MemoryPropertyFlagBits::eDeviceLocal, texture.allocation,
+      texture.mipLevels);
+
+  uploadImage(texture.image, texture.format, image.pixels, imageSize, width,
+              height, texture.mipLevels);
+  texture.view =
+      createImageView(texture.image, texture.format, texture.mipLevels);
+
+  return texture;
+}
+
+// doesn't touch vulkan so it can run on any thread, a missing file isn't an
+// error but a broken one is
+CookedTexture mapCookedTexture(const char* path) {
+  CookedTexture texture;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return texture;
+
+  struct stat info;
+  if (fstat(fd, &info) < 0) {
+    close(fd);
+    throw std::runtime_error("failed to stat cooked texture");
+  }
+
+  texture.size = static_cast<size_t>(info.st_size);
+  if (texture.size < sizeof(TextureFileHeader)) {
+    close(fd);
+    throw std::runtime_error("cooked texture is truncated");
+  }
+
+  texture.mapping = mmap(nullptr, texture.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps the file alive
+  close(fd);
+
+  if (texture.mapping == MAP_FAILED)
+    throw std::runtime_error("failed to map cooked texture");
+
+  const uint8_t* bytes = static_cast<const uint8_t*>(texture.mapping);
+  texture.header = reinterpret_cast<const TextureFileHeader*>(bytes);
+  texture.levels = reinterpret_cast<const TextureFileLevel*>(
+      bytes + sizeof(TextureFileHeader));
+
+  const TextureFileHeader& header = *texture.header;
+  bool valid = header.magic == TextureFileHeader::MAGIC &&
+               header.version == TextureFileHeader::VERSION &&
+               (header.format == TextureFileFormat::BC1 ||
+                header.format == TextureFileFormat::BC3) &&
+               header.width > 0 && header.height > 0 && header.mipLevels > 0 &&
+               header.mipLevels <= mipLevelCount(header.width, header.height) &&
+               sizeof(TextureFileHeader) +
+                       header.mipLevels * sizeof(TextureFileLevel) <=
+                   texture.size;
+
+  for (uint32_t i = 0; valid && i < header.mipLevels; i++) {
+    const TextureFileLevel& level = texture.levels[i];
+    uint64_t blocksWide = (std::max(header.width >> i, 1u) + 3) / 4;
+    uint64_t blocksHigh = (std::max(header.height >> i, 1u) + 3) / 4;
+    valid = level.offset % 16 == 0 && level.offset <= texture.size &&
+            level.size <= texture.size - level.offset &&
+            level.size ==
+                blocksWide * blocksHigh * textureBlockSize(header.format);
+  }
+
+  if (!valid) {
+    unmapCookedTexture(texture);
+    throw std::runtime_error("invalid cooked texture");
+  }
+
+  // the kernel can start reading the level data before we copy it
+  madvise(texture.mapping, texture.size, MADV_WILLNEED);
+
+  return texture;
+}
+
+void unmapCookedTexture(CookedTexture& texture) {
+  if (texture.mapping)
+    munmap(texture.mapping, texture.size);
+  texture = CookedTexture();
+}
+
+vk::Format cookedTextureFormat(const TextureFileHeader& header) {
+  switch (header.format) {
+  case TextureFileFormat::BC1:
+    return vk::Format::eBc1RgbaUnormBlock;
+  case TextureFileFormat::BC3:
+    return vk::Format::eBc3UnormBlock;
+  }
+
+  throw std::invalid_argument("unknown cooked texture format");
+}
+
+bool canSampleFormat(vk::Format format) {
+  auto features =
+      vkctx.physicalDevice.getFormatProperties(format).optimalTilingFeatures;
+
+  return (features & vk::FormatFeatureFlagBits::eSampledImage) &&
+         (features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear);
+}
+
+// the whole mip chain is already in the file, so the level data is copied
+// from the mapping into staging in one go and nothing is blitted
+Texture createCookedTexture(const CookedTexture& cooked) {
+  const TextureFileHeader& header = *cooked.header;
+
+  uint64_t first = cooked.levels[0].offset;
+  uint64_t end = 0;
+  std::vector<vk::DeviceSize> levelOffsets;
+  for (uint32_t i = 0; i < header.mipLevels; i++) {
+    first = std::min(first, cooked.levels[i].offset);
+    end = std::max(end, cooked.levels[i].offset + cooked.levels[i].size);
+  }
+  for (uint32_t i = 0; i < header.mipLevels; i++)
+    levelOffsets.push_back(cooked.levels[i].offset - first);
+
+  Texture texture;
+  texture.format = cookedTextureFormat(header);
+  texture.mipLevels = header.mipLevels;
+  texture.image = createImage(
+      header.width, header.height, texture.format, vk::ImageTiling::eOptimal,
       vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-      vk::MemoryPropertyFlagBits::eDeviceLocal, vkctx.textureAllocation);
-  transitiionImageLayout(vkctx.textureImage, vk::Format::eR8G8B8A8Unorm,
-                         vk::ImageLayout::eUndefined,
-                         vk::ImageLayout::eTransferDstOptimal);
-  copyBufferToImage(stagingBuffer, vkctx.textureImage,
-                    static_cast<uint32_t>(texWidth),
-                    static_cast<uint32_t>(texHeight));
-  transitiionImageLayout(vkctx.textureImage, vk::Format::eR8G8B8A8Unorm,
-                         vk::ImageLayout::eTransferDstOptimal,
-                         vk::ImageLayout::eShaderReadOnlyOptimal);
-  vmaDestroyBuffer(vkctx.allocator, stagingBuffer, stagingAllocation);
+      vk::MemoryPropertyFlagBits::eDeviceLocal, texture.allocation,
+      texture.mipLevels);
+
+  uploadImageLevels(texture.image, texture.format,
+                    static_cast<const uint8_t*>(cooked.mapping) + first,
+                    end - first, header.width, header.height, levelOffsets);
+  texture.view =
+      createImageView(texture.image, texture.format, texture.mipLevels);
+
+  return texture;
 }
 
-vk::ImageView createImageView(vk::Image image, vk::Format format) {
-  vk::ImageViewCreateInfo info(
-      {}, image, vk::ImageViewType::e2D, format, {},
-      vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+vk::ImageView createImageView(vk::Image image, vk::Format format,
+                              uint32_t mipLevels) {
+  vk::ImageViewCreateInfo info({}, image, vk::ImageViewType::e2D, format, {},
+                               vk::ImageSubresourceRange(
+                                   vk::ImageAspectFlagBits::eColor, 0,
+                                   mipLevels, 0, 1));
 
   return vkctx.device.createImageView(info);
 }
 
-void createTextureImageView() {
-  vkctx.textureImageView =
-      createImageView(vkctx.textureImage, vk::Format::eR8G8B8A8Unorm);
+void destroyTexture(Texture& texture) {
+  vkctx.device.destroyImageView(texture.view);
+  vmaDestroyImage(vkctx.allocator, texture.image, texture.allocation);
+  texture = Texture();
 }
@@ -0,0 +1,94 @@
+#include <jobs.hpp>
+
+static std::atomic<uint64_t> sink{0};
+
+// a fixed amount of arithmetic standing in for a small real job
+static void work(uint32_t seed) {
+  uint64_t value = seed;
+  for (uint32_t i = 0; i < 2000; i++)
+    value = value * 6364136223846793005ull + 1442695040888963407ull;
+  sink.fetch_add(value, std::memory_order_relaxed);
+}
+
+static double elapsedNs(std::chrono::steady_clock::time_point start,
+                        std::chrono::steady_clock::time_point end) {
+  return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+// measures job spawn, steal and completion overhead and how a fixed workload
+// scales with the thread count, steal_ns is the time per stolen job spent
+// finding and taking it, prints json, usage: jobbench [max threads]
+int main(int argc, char** argv) {
+  uint32_t maxThreads = argc > 1 ? std::stoul(argv[1]) : 64;
+  const uint32_t JOBS = 100000;
+
+  double baseline = 0.0;
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "{" << std::endl;
+  std::cout << "  \"jobs\": " << JOBS << "," << std::endl;
+  std::cout << "  \"hardware_threads\": " << std::thread::hardware_concurrency()
+            << "," << std::endl;
+  std::cout << "  \"runs\": [" << std::endl;
+
+  for (uint32_t threads = 1; threads <= maxThreads; threads *= 2) {
+    initJobs(threads);
+
+    // empty jobs all spawned from this thread, every other worker has to
+    // steal its share
+    uint64_t stealsBefore = jobSteals();
+    uint64_t stealNsBefore = jobStealNs();
+    JobCounter emptyCounter;
+    auto spawnStart = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < JOBS; i++)
+      runJob([] {}, &emptyCounter);
+    auto spawnEnd = std::chrono::steady_clock::now();
+    waitForJobs(emptyCounter);
+    auto emptyEnd = std::chrono::steady_clock::now();
+    uint64_t emptySteals = jobSteals() - stealsBefore;
+    uint64_t emptyStealNs = jobStealNs() - stealNsBefore;
+
+    // the same number of jobs doing real work
+    JobCounter workCounter;
+    auto workStart = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < JOBS; i++)
+      runJob([i] { work(i); }, &workCounter);
+    waitForJobs(workCounter);
+    auto workEnd = std::chrono::steady_clock::now();
+
+    // a chain of continuations, each one only starts after the previous one
+    std::vector<JobCounter> chain(1000);
+    auto chainStart = std::chrono::steady_clock::now();
+    runJob([] {}, &chain[0]);
+    for (uint32_t i = 1; i < chain.size(); i++)
+      runJobAfter(chain[i - 1], [] {}, &chain[i]);
+    for (auto& counter : chain)
+      waitForJobs(counter);
+    auto chainEnd = std::chrono::steady_clock::now();
+
+    double workMs = elapsedNs(workStart, workEnd) / 1e6;
+    if (threads == 1)
+      baseline = workMs;
+
+    std::cout << "    {\"threads\": " << threads << ", ";
+    std::cout << "\"spawn_ns\": " << elapsedNs(spawnStart, spawnEnd) / JOBS
+              << ", ";
+    std::cout << "\"empty_job_ns\": "
+              << elapsedNs(spawnStart, emptyEnd) / JOBS << ", ";
+    std::cout << "\"steals\": " << emptySteals << ", ";
+    std::cout << "\"steal_ns\": "
+              << (emptySteals ? static_cast<double>(emptyStealNs) / emptySteals
+                              : 0.0)
+              << ", ";
+    std::cout << "\"continuation_ns\": "
+              << elapsedNs(chainStart, chainEnd) / chain.size() << ", ";
+    std::cout << "\"work_ms\": " << workMs << ", ";
+    std::cout << "\"speedup\": " << baseline / workMs << "}";
+    std::cout << (threads * 2 <= maxThreads ? "," : "") << std::endl;
+
+    cleanupJobs();
+  }
+
+  std::cout << "  ]" << std::endl;
+  std::cout << "}" << std::endl;
+}
@@ -0,0 +1,317 @@
+#include <jobs.hpp>
+
+struct QueuedJob {
+  Job job;
+  JobCounter* counter;
+};
+
+// the owner pushes and pops at the back, thieves take from the front so they
+// get the oldest and usually largest pieces of work
+struct JobQueue {
+  std::mutex mutex;
+  std::deque<QueuedJob> jobs;
+};
+
+// queue 0 is shared by every thread outside the pool, like the main thread
+static std::vector<std::unique_ptr<JobQueue>> queues;
+// long running jobs, only idle workers take them, a thread waiting for some
+// other counter never does, so they can't stall a frame
+static JobQueue backgroundQueue;
+static std::vector<std::thread> threads;
+static std::atomic<uint32_t> queuedJobs{0};
+static std::atomic<uint32_t> sleepingThreads{0};
+static std::atomic<uint64_t> steals{0};
+// spent looking for and taking a job from another queue, only counted for
+// searches that found one
+static std::atomic<uint64_t> stealNs{0};
+static std::atomic<bool> quit{false};
+static std::mutex sleepMutex;
+static std::condition_variable sleepCondition;
+
+static thread_local uint32_t queueIndex = 0;
+static thread_local uint32_t randomState = 0x9e3779b9;
+
+static inline uint32_t nextRandom() {
+  // xorshift, good enough to spread thieves over their victims
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+// pairs with the sleepingThreads increment in workerLoop, either we see the
+// sleeper or it sees the new job before going to sleep
+static void wakeWorker() {
+  queuedJobs.fetch_add(1);
+  if (sleepingThreads.load() > 0) {
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    sleepCondition.notify_one();
+  }
+}
+
+static void pushJob(QueuedJob job) {
+  JobQueue& queue = *queues[queueIndex];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back(std::move(job));
+  }
+
+  wakeWorker();
+}
+
+static void pushBackgroundJob(QueuedJob job) {
+  {
+    std::lock_guard<std::mutex> lock(backgroundQueue.mutex);
+    backgroundQueue.jobs.push_back(std::move(job));
+  }
+
+  wakeWorker();
+}
+
+static bool popJob(QueuedJob& job) {
+  {
+    JobQueue& queue = *queues[queueIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      job = std::move(queue.jobs.back());
+      queue.jobs.pop_back();
+      queuedJobs.fetch_sub(1);
+      return true;
+    }
+  }
+
+  auto searchStart = std::chrono::steady_clock::now();
+  uint32_t count = static_cast<uint32_t>(queues.size());
+  uint32_t start = nextRandom() % count;
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t victim = (start + i) % count;
+    if (victim == queueIndex)
+      continue;
+
+    JobQueue& queue = *queues[victim];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      job = std::move(queue.jobs.front());
+      queue.jobs.pop_front();
+      queuedJobs.fetch_sub(1);
+      steals.fetch_add(1, std::memory_order_relaxed);
+      auto searchTime = std::chrono::steady_clock::now() - searchStart;
+      stealNs.fetch_add(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(searchTime)
+              .count(),
+          std::memory_order_relaxed);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// the oldest background job, or with a counter the oldest one it counts
+static bool popBackgroundJob(QueuedJob& job, const JobCounter* counter) {
+  std::lock_guard<std::mutex> lock(backgroundQueue.mutex);
+  auto& jobs = backgroundQueue.jobs;
+
+  auto it = jobs.begin();
+  if (counter) {
+    it = std::find_if(jobs.begin(), jobs.end(),
+                      [counter](const QueuedJob& queued) {
+                        return queued.counter == counter;
+                      });
+  }
+  if (it == jobs.end())
+    return false;
+
+  job = std::move(*it);
+  jobs.erase(it);
+  queuedJobs.fetch_sub(1);
+  return true;
+}
+
+static void finishJob(JobCounter* counter) {
+  std::vector<std::pair<Job, JobCounter*>> continuations;
+  {
+    // decrement under the lock so a waiter can't free the counter while we
+    // are still using it, see waitForJobs
+    std::lock_guard<std::mutex> lock(counter->mutex);
+    if (counter->pending.fetch_sub(1) == 1) {
+      continuations.swap(counter->continuations);
+      counter->finished.notify_all();
+    }
+  }
+
+  for (auto& continuation : continuations)
+    pushJob({std::move(continuation.first), continuation.second});
+}
+
+static void executeJob(QueuedJob& job) {
+  if (!job.counter) {
+    job.job();
+    return;
+  }
+
+  try {
+    job.job();
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(job.counter->mutex);
+    if (!job.counter->error)
+      job.counter->error = std::current_exception();
+  }
+
+  finishJob(job.counter);
+}
+
+static void workerLoop(uint32_t index) {
+  queueIndex = index;
+  randomState += index * 0x6d2b79f5;
+
+  while (!quit.load()) {
+    QueuedJob job;
+    if (popJob(job) || popBackgroundJob(job, nullptr)) {
+      executeJob(job);
+      continue;
+    }
+
+    sleepingThreads.fetch_add(1);
+    {
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      sleepCondition.wait(
+          lock, [] { return quit.load() || queuedJobs.load() > 0; });
+    }
+    sleepingThreads.fetch_sub(1);
+  }
+}
+
+// threads is the total including the calling thread, 0 picks one per core
+void initJobs(uint32_t threadCount) {
+  if (threadCount == 0)
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+  quit = false;
+  for (uint32_t i = 0; i < threadCount; i++)
+    queues.push_back(std::make_unique<JobQueue>());
+
+  for (uint32_t i = 1; i < threadCount; i++)
+    threads.emplace_back(workerLoop, i);
+}
+
+void cleanupJobs() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    quit = true;
+  }
+  sleepCondition.notify_all();
+
+  for (auto& thread : threads)
+    thread.join();
+
+  threads.clear();
+  queues.clear();
+  backgroundQueue.jobs.clear();
+  queuedJobs = 0;
+}
+
+uint32_t jobThreadCount() { return static_cast<uint32_t>(queues.size()); }
+
+uint64_t jobSteals() { return steals.load(); }
+
+uint64_t jobStealNs() { return stealNs.load(); }
+
+void runJob(Job job, JobCounter* counter) {
+  if (counter)
+    counter->pending.fetch_add(1);
+
+  pushJob({std::move(job), counter});
+}
+
+// for work that takes long enough to show up as a hitch if a frame ran it,
+// without worker threads it's queued like any other job
+void runBackgroundJob(Job job, JobCounter* counter) {
+  if (counter)
+    counter->pending.fetch_add(1);
+
+  if (threads.empty())
+    pushJob({std::move(job), counter});
+  else
+    pushBackgroundJob({std::move(job), counter});
+}
+
+// starts job once every job counted by dependency has finished
+void runJobAfter(JobCounter& dependency, Job job, JobCounter* counter) {
+  if (counter)
+    counter->pending.fetch_add(1);
+
+  {
+    std::lock_guard<std::mutex> lock(dependency.mutex);
+    if (dependency.pending.load() > 0) {
+      dependency.continuations.emplace_back(std::move(job), counter);
+      return;
+    }
+  }
+
+  pushJob({std::move(job), counter});
+}
+
+// runs other jobs while waiting instead of blocking the thread, background
+// jobs only if they're counted by counter, with nothing to run it spins for a
+// bit and then sleeps until the counter finishes, checking for new jobs every
+// millisecond
+void waitForJobs(JobCounter& counter) {
+  const uint32_t SPINS = 64;
+  uint32_t idle = 0;
+
+  while (counter.pending.load() > 0) {
+    QueuedJob job;
+    if (popJob(job) || popBackgroundJob(job, &counter)) {
+      executeJob(job);
+      idle = 0;
+      continue;
+    }
+
+    // without workers nobody else could finish the counter's jobs
+    if (++idle < SPINS || threads.empty()) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(counter.mutex);
+    counter.finished.wait_for(lock, std::chrono::milliseconds(1), [&counter] {
+      return counter.pending.load() == 0;
+    });
+  }
+
+  // the last finishJob may still hold the lock
+  std::lock_guard<std::mutex> lock(counter.mutex);
+  if (counter.error) {
+    auto error = counter.error;
+    counter.error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+// splits [0, count) into chunks, runs the first on the calling thread and the
+// rest as jobs, returns once all of them are done
+void parallelFor(
+    uint32_t count, uint32_t chunks,
+    const std::function<void(uint32_t chunk, uint32_t first, uint32_t last)>&
+        job) {
+  chunks = std::max(chunks, 1u);
+  uint32_t perChunk = (count + chunks - 1) / chunks;
+
+  JobCounter counter;
+  for (uint32_t chunk = 1; chunk < chunks; chunk++) {
+    uint32_t first = std::min(chunk * perChunk, count);
+    uint32_t last = std::min(first + perChunk, count);
+    runJob([&job, chunk, first, last] { job(chunk, first, last); }, &counter);
+  }
+
+  try {
+    job(0, 0, std::min(perChunk, count));
+  } catch (...) {
+    // the other chunks still reference job, let them finish first
+    waitForJobs(counter);
+    throw;
+  }
+  waitForJobs(counter);
+}
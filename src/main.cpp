@@ -1,11 +1,124 @@
 #include <main.hpp>
+#include <profiler.hpp>
+#include <startup.hpp>
 #include <vulkan.hpp>
 
 VulkanContext vkctx;
 
-int main() {
+static bool parsePresentPolicy(const std::string& name,
+                               PresentPolicy& policy) {
+  if (name == "throughput")
+    policy = PresentPolicy::Throughput;
+  else if (name == "low-latency")
+    policy = PresentPolicy::LowLatency;
+  else if (name == "vsync")
+    policy = PresentPolicy::Vsync;
+  else
+    return false;
+
+  return true;
+}
+
+// the whole value has to be a number, nothing after it
+static bool parseCount(const std::string& value, uint32_t& count) {
+  if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])))
+    return false;
+
+  char* end;
+  errno = 0;
+  unsigned long number = std::strtoul(value.c_str(), &end, 10);
+  if (*end != '\0' || errno == ERANGE || number > UINT32_MAX)
+    return false;
+
+  count = static_cast<uint32_t>(number);
+  return true;
+}
+
+static bool parseRate(const std::string& value, double& rate) {
+  if (value.empty())
+    return false;
+
+  char* end;
+  errno = 0;
+  double number = std::strtod(value.c_str(), &end);
+  if (*end != '\0' || errno == ERANGE || !std::isfinite(number) ||
+      number < 0.0)
+    return false;
+
+  rate = number;
+  return true;
+}
+
+static bool parseSampleCount(const std::string& value, uint32_t& samples) {
+  if (value == "1" || value == "2" || value == "4" || value == "8" ||
+      value == "16")
+    samples = std::stoul(value);
+  else
+    return false;
+
+  return true;
+}
+
+static bool parseShadingView(const std::string& name, ShadingView& view) {
+  if (name == "textured")
+    view = ShadingView::Textured;
+  else if (name == "colors")
+    view = ShadingView::VertexColors;
+  else if (name == "uvs")
+    view = ShadingView::TexCoords;
+  else
+    return false;
+
+  return true;
+}
+
+// usage: main [--frames-in-flight 1-4]
+//             [--present throughput|low-latency|vsync] [--fps limit]
+//             [--view textured|colors|uvs] [--depth-prepass on|off]
+//             [--msaa 1|2|4|8|16]
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i += 2) {
+    std::string option = argv[i];
+    if (i + 1 == argc) {
+      std::cerr << "missing value for " << option << std::endl;
+      return 1;
+    }
+    std::string value = argv[i + 1];
+
+    if (option == "--frames-in-flight") {
+      if (!parseCount(value, vkctx.framesInFlight)) {
+        std::cerr << "invalid frames in flight " << value << std::endl;
+        return 1;
+      }
+    } else if (option == "--fps") {
+      double fps;
+      if (!parseRate(value, fps)) {
+        std::cerr << "invalid fps " << value << std::endl;
+        return 1;
+      }
+      vkctx.targetFrameTime = fps > 0.0 ? 1000.0 / fps : 0.0;
+    } else if (option == "--view") {
+      if (!parseShadingView(value, vkctx.shadingView)) {
+        std::cerr << "unknown view " << value << std::endl;
+        return 1;
+      }
+    } else if (option == "--depth-prepass" &&
+               (value == "on" || value == "off")) {
+      vkctx.depthPrepass = value == "on";
+    } else if (option == "--msaa") {
+      if (!parseSampleCount(value, vkctx.msaa)) {
+        std::cerr << "unsupported msaa " << value << std::endl;
+        return 1;
+      }
+    } else if (option != "--present" ||
+               !parsePresentPolicy(value, vkctx.presentPolicy)) {
+      std::cerr << "unknown option " << option << " " << value << std::endl;
+      return 1;
+    }
+  }
+
   bool quit = false;
-  initSDL();
+  startupStep("init sdl", initSDL);
   initVulkan();
   SDL_Event* evt = new SDL_Event;
   while (!quit) {
@@ -15,6 +128,22 @@ int main() {
         // case SDL_KEYDOWN:
         quit = true;
         break;
+      // f1 toggles profiling, f2 saves what it has recorded so far, f3
+      // cycles through the present policies and f4 through the shading views
+      case SDL_KEYDOWN:
+        if (evt->key.keysym.sym == SDLK_F1) {
+          setProfiling(!profiling());
+        } else if (evt->key.keysym.sym == SDLK_F2) {
+          if (writeProfileTrace("profile.json"))
+            std::cerr << "wrote profile.json" << std::endl;
+        } else if (evt->key.keysym.sym == SDLK_F3) {
+          setPresentPolicy(static_cast<PresentPolicy>(
+              (static_cast<int>(vkctx.presentPolicy) + 1) % 3));
+        } else if (evt->key.keysym.sym == SDLK_F4) {
+          setShadingView(static_cast<ShadingView>(
+              (static_cast<int>(vkctx.shadingView) + 1) % 3));
+        }
+        break;
       case SDL_WINDOWEVENT:
         switch (evt->window.event) {
         case SDL_WINDOWEVENT_RESIZED:
@@ -0,0 +1,249 @@
+#include <mesh.hpp>
+#include <resources.hpp>
+#include <upload.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(Vertex) == sizeof(FloatVertex),
+              "float meshes are uploaded as Vertex");
+
+// mapped by loadSceneMesh and released once createMeshBuffers has copied it
+// into staging
+static MappedMesh sceneFile;
+
+// the index data is 16 byte aligned, so it can be read in place
+static uint32_t maxIndex(const uint8_t* indices, uint32_t count,
+                         uint32_t indexSize) {
+  uint32_t max = 0;
+  if (indexSize == 2) {
+    const uint16_t* values = reinterpret_cast<const uint16_t*>(indices);
+    for (uint32_t i = 0; i < count; i++)
+      max = std::max<uint32_t>(max, values[i]);
+  } else {
+    const uint32_t* values = reinterpret_cast<const uint32_t*>(indices);
+    for (uint32_t i = 0; i < count; i++)
+      max = std::max(max, values[i]);
+  }
+
+  return max;
+}
+
+MappedMesh mapMesh(const char* path) {
+  MappedMesh mesh;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return mesh;
+
+  struct stat info;
+  if (fstat(fd, &info) < 0) {
+    close(fd);
+    throw std::runtime_error("failed to stat mesh");
+  }
+
+  mesh.size = static_cast<size_t>(info.st_size);
+  if (mesh.size < sizeof(MeshFileHeader)) {
+    close(fd);
+    throw std::runtime_error("mesh is truncated");
+  }
+
+  mesh.mapping = mmap(nullptr, mesh.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps the file alive
+  close(fd);
+
+  if (mesh.mapping == MAP_FAILED)
+    throw std::runtime_error("failed to map mesh");
+
+  const uint8_t* bytes = static_cast<const uint8_t*>(mesh.mapping);
+  mesh.header = reinterpret_cast<const MeshFileHeader*>(bytes);
+
+  const MeshFileHeader& header = *mesh.header;
+  uint64_t vertexBytes =
+      static_cast<uint64_t>(header.vertexCount) * meshVertexSize(header.layout);
+  uint64_t indexBytes =
+      static_cast<uint64_t>(header.indexCount) * header.indexSize;
+  bool valid = header.magic == MeshFileHeader::MAGIC &&
+               header.version == MeshFileHeader::VERSION &&
+               (header.layout == MeshVertexLayout::Float ||
+                header.layout == MeshVertexLayout::Quantized) &&
+               (header.indexSize == 2 || header.indexSize == 4) &&
+               header.vertexCount > 0 && header.indexCount > 0 &&
+               header.indexCount % 3 == 0 &&
+               (header.indexSize == 4 || header.vertexCount <= 65536) &&
+               header.vertexOffset % 16 == 0 &&
+               header.indexOffset % 16 == 0 &&
+               header.vertexOffset <= mesh.size &&
+               vertexBytes <= mesh.size - header.vertexOffset &&
+               header.indexOffset <= mesh.size &&
+               indexBytes <= mesh.size - header.indexOffset;
+
+  // an index past the last vertex would have the gpu read outside the
+  // vertex buffer
+  valid = valid && maxIndex(bytes + header.indexOffset, header.indexCount,
+                            header.indexSize) < header.vertexCount;
+
+  if (!valid) {
+    unmapMesh(mesh);
+    throw std::runtime_error("invalid mesh");
+  }
+
+  mesh.vertices = bytes + header.vertexOffset;
+  mesh.indices = bytes + header.indexOffset;
+
+  madvise(mesh.mapping, mesh.size, MADV_WILLNEED);
+
+  return mesh;
+}
+
+void unmapMesh(MappedMesh& mesh) {
+  if (mesh.mapping)
+    munmap(mesh.mapping, mesh.size);
+  mesh = MappedMesh();
+}
+
+// has to run before the pipelines are created since the mesh's layout
+// decides their vertex input, falls back to the built in quad without a file,
+// the buffers are created by createMeshBuffers once there is a device
+MeshHandle loadSceneMesh(const char* path) {
+  sceneFile = mapMesh(path);
+  Mesh mesh;
+
+  if (sceneFile.header) {
+    const MeshFileHeader& header = *sceneFile.header;
+    mesh.layout = header.layout;
+    mesh.indexType = header.indexSize == 2 ? vk::IndexType::eUint16
+                                           : vk::IndexType::eUint32;
+    mesh.indexCount = header.indexCount;
+    std::copy_n(header.boundsMin, 3, mesh.boundsMin);
+    std::copy_n(header.boundsMax, 3, mesh.boundsMax);
+  } else {
+    mesh.indexCount = static_cast<uint32_t>(indices.size());
+    for (int axis = 0; axis < 3; axis++) {
+      mesh.boundsMin[axis] = vertices[0].pos[axis];
+      mesh.boundsMax[axis] = vertices[0].pos[axis];
+      for (const auto& vertex : vertices) {
+        mesh.boundsMin[axis] = std::min(mesh.boundsMin[axis], vertex.pos[axis]);
+        mesh.boundsMax[axis] = std::max(mesh.boundsMax[axis], vertex.pos[axis]);
+      }
+    }
+  }
+
+  return addMesh(mesh);
+}
+
+// the vertex and index data is copied straight from the mapping into staging
+void createMeshBuffers(MeshHandle handle) {
+  const void* vertexData = vertices.data();
+  vk::DeviceSize vertexSize = sizeof(Vertex) * vertices.size();
+  const void* indexData = indices.data();
+  vk::DeviceSize indexSize = sizeof(uint16_t) * indices.size();
+
+  if (sceneFile.header) {
+    const MeshFileHeader& header = *sceneFile.header;
+    vertexData = sceneFile.vertices;
+    vertexSize = static_cast<vk::DeviceSize>(header.vertexCount) *
+                 meshVertexSize(header.layout);
+    indexData = sceneFile.indices;
+    indexSize = static_cast<vk::DeviceSize>(header.indexCount) *
+                header.indexSize;
+  }
+
+  BufferHandle vertexBuffer =
+      addBuffer(vertexSize,
+                vk::BufferUsageFlagBits::eTransferDst |
+                    vk::BufferUsageFlagBits::eVertexBuffer,
+                vk::MemoryPropertyFlagBits::eDeviceLocal,
+                VMA_MEMORY_USAGE_GPU_ONLY);
+
+  uploadBuffer(getBuffer(vertexBuffer).buffer, vertexData, vertexSize,
+               vk::AccessFlagBits::eVertexAttributeRead,
+               vk::PipelineStageFlagBits::eVertexInput);
+
+  BufferHandle indexBuffer =
+      addBuffer(indexSize,
+                vk::BufferUsageFlagBits::eTransferDst |
+                    vk::BufferUsageFlagBits::eIndexBuffer,
+                vk::MemoryPropertyFlagBits::eDeviceLocal,
+                VMA_MEMORY_USAGE_GPU_ONLY);
+
+  uploadBuffer(getBuffer(indexBuffer).buffer, indexData, indexSize,
+               vk::AccessFlagBits::eIndexRead,
+               vk::PipelineStageFlagBits::eVertexInput);
+
+  Mesh& mesh = *vkctx.meshes.get(handle);
+  mesh.vertexBuffer = vertexBuffer;
+  mesh.indexBuffer = indexBuffer;
+
+  unmapMesh(sceneFile);
+}
+
+vk::VertexInputBindingDescription
+meshBindingDescription(MeshVertexLayout layout) {
+  if (layout == MeshVertexLayout::Float)
+    return Vertex::getBindingDescription();
+
+  return vk::VertexInputBindingDescription(0, sizeof(QuantizedVertex));
+}
+
+// same locations for every layout, the shaders read floats either way
+std::vector<vk::VertexInputAttributeDescription>
+meshAttributeDescriptions(MeshVertexLayout layout) {
+  if (layout == MeshVertexLayout::Float) {
+    auto descriptions = Vertex::getAttributeDescription();
+    return {descriptions.begin(), descriptions.end()};
+  }
+
+  return {
+      {0, 0, vk::Format::eR16G16B16A16Snorm,
+       offsetof(QuantizedVertex, position)},
+      {1, 0, vk::Format::eR8G8B8A8Unorm, offsetof(QuantizedVertex, color)},
+      {2, 0, vk::Format::eR16G16Unorm, offsetof(QuantizedVertex, texCoord)},
+  };
+}
+
+// maps quantized positions back into the mesh bounds, goes on the right of
+// an object's model matrix
+glm::mat4 meshDequantize(const Mesh& mesh) {
+  if (mesh.layout == MeshVertexLayout::Float)
+    return glm::mat4(1.0f);
+
+  glm::vec3 center, scale;
+  for (int axis = 0; axis < 3; axis++) {
+    center[axis] = (mesh.boundsMin[axis] + mesh.boundsMax[axis]) * 0.5f;
+    scale[axis] = meshQuantizeScale(mesh.boundsMin[axis], mesh.boundsMax[axis]);
+  }
+
+  return glm::scale(glm::translate(glm::mat4(1.0f), center), scale);
+}
+
+// the corners of the mesh bounds in the space of its vertex data, so they go
+// through meshDequantize, quantized positions span -1 to 1 on every axis
+std::array<glm::vec4, 8> meshCorners(const Mesh& mesh) {
+  bool quantized = mesh.layout == MeshVertexLayout::Quantized;
+  std::array<glm::vec4, 8> corners;
+
+  for (uint32_t i = 0; i < corners.size(); i++) {
+    glm::vec4& corner = corners[i];
+    corner.w = 1.0f;
+    for (int axis = 0; axis < 3; axis++) {
+      bool high = i & (1 << axis);
+      if (quantized)
+        corner[axis] = high ? 1.0f : -1.0f;
+      else
+        corner[axis] = high ? mesh.boundsMax[axis] : mesh.boundsMin[axis];
+    }
+  }
+
+  return corners;
+}
+
+// center in xyz and radius in w, in the space meshDequantize maps into
+glm::vec4 meshBoundingSphere(const Mesh& mesh) {
+  glm::vec3 min(mesh.boundsMin[0], mesh.boundsMin[1], mesh.boundsMin[2]);
+  glm::vec3 max(mesh.boundsMax[0], mesh.boundsMax[1], mesh.boundsMax[2]);
+
+  return glm::vec4((min + max) * 0.5f, glm::length(max - min) * 0.5f);
+}
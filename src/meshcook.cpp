@@ -0,0 +1,487 @@
+#include <meshfile.hpp>
+
+struct Mesh {
+  std::vector<FloatVertex> vertices;
+  std::vector<uint32_t> indices;
+};
+
+// obj indices start at 1 and negative ones count back from the end
+static bool resolveIndex(long index, size_t count, size_t& out) {
+  if (index > 0 && static_cast<size_t>(index) <= count) {
+    out = static_cast<size_t>(index - 1);
+    return true;
+  }
+  if (index < 0 && static_cast<size_t>(-index) <= count) {
+    out = count - static_cast<size_t>(-index);
+    return true;
+  }
+  return false;
+}
+
+// reads positions, optional vertex colors after them, texture coordinates and
+// faces, normals are ignored and polygons are split into fans, vertices are
+// shared between faces that use the same position and texture coordinate
+static bool loadObj(const char* path, Mesh& mesh) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "failed to open " << path << std::endl;
+    return false;
+  }
+
+  std::vector<std::array<float, 6>> positions;
+  std::vector<std::array<float, 2>> texCoords;
+  std::map<std::pair<size_t, size_t>, uint32_t> shared;
+
+  std::string line;
+  for (uint32_t lineNumber = 1; std::getline(file, line); lineNumber++) {
+    std::istringstream stream(line);
+    std::string keyword;
+    stream >> keyword;
+
+    if (keyword == "v") {
+      std::array<float, 6> position = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+      stream >> position[0] >> position[1] >> position[2];
+      if (!stream) {
+        std::cerr << path << ":" << lineNumber << ": bad position"
+                  << std::endl;
+        return false;
+      }
+      float r, g, b;
+      if (stream >> r >> g >> b) {
+        position[3] = r;
+        position[4] = g;
+        position[5] = b;
+      }
+      positions.push_back(position);
+    } else if (keyword == "vt") {
+      std::array<float, 2> texCoord = {0.0f, 0.0f};
+      stream >> texCoord[0] >> texCoord[1];
+      texCoords.push_back(texCoord);
+    } else if (keyword == "f") {
+      std::vector<uint32_t> face;
+      std::string corner;
+      while (stream >> corner) {
+        char* end;
+        long positionIndex = std::strtol(corner.c_str(), &end, 10);
+        long texCoordIndex = 0;
+        if (*end == '/' && end[1] != '/')
+          texCoordIndex = std::strtol(end + 1, &end, 10);
+
+        size_t p, t = SIZE_MAX;
+        if (!resolveIndex(positionIndex, positions.size(), p) ||
+            (texCoordIndex != 0 &&
+             !resolveIndex(texCoordIndex, texCoords.size(), t))) {
+          std::cerr << path << ":" << lineNumber << ": bad face" << std::endl;
+          return false;
+        }
+
+        auto [it, inserted] = shared.try_emplace(
+            {p, t}, static_cast<uint32_t>(mesh.vertices.size()));
+        if (inserted) {
+          FloatVertex vertex = {};
+          std::copy_n(positions[p].begin(), 3, vertex.position);
+          std::copy_n(positions[p].begin() + 3, 3, vertex.color);
+          if (t != SIZE_MAX) {
+            // obj's v points up, vulkan's down
+            vertex.texCoord[0] = texCoords[t][0];
+            vertex.texCoord[1] = 1.0f - texCoords[t][1];
+          }
+          mesh.vertices.push_back(vertex);
+        }
+        face.push_back(it->second);
+      }
+
+      for (size_t i = 2; i < face.size(); i++) {
+        mesh.indices.push_back(face[0]);
+        mesh.indices.push_back(face[i - 1]);
+        mesh.indices.push_back(face[i]);
+      }
+    }
+  }
+
+  if (mesh.indices.empty()) {
+    std::cerr << path << ": no faces" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+static int16_t quantizeSnorm16(float value) {
+  return static_cast<int16_t>(
+      std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+static uint16_t quantizeUnorm16(float value) {
+  return static_cast<uint16_t>(
+      std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+static uint8_t quantizeUnorm8(float value) {
+  return static_cast<uint8_t>(
+      std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+// positions are stored relative to the bounds so the full snorm16 range
+// covers the mesh, the engine scales them back with the bounds in the header
+static std::vector<QuantizedVertex> quantize(const Mesh& mesh,
+                                             const MeshFileHeader& header) {
+  std::vector<QuantizedVertex> quantized(mesh.vertices.size());
+  bool clamped = false;
+
+  for (size_t i = 0; i < mesh.vertices.size(); i++) {
+    const FloatVertex& src = mesh.vertices[i];
+    QuantizedVertex& dst = quantized[i];
+
+    for (int axis = 0; axis < 3; axis++) {
+      float center = (header.boundsMin[axis] + header.boundsMax[axis]) * 0.5f;
+      float scale =
+          meshQuantizeScale(header.boundsMin[axis], header.boundsMax[axis]);
+      dst.position[axis] =
+          quantizeSnorm16((src.position[axis] - center) / scale);
+      dst.color[axis] = quantizeUnorm8(src.color[axis]);
+    }
+    dst.position[3] = 32767;
+    dst.color[3] = 255;
+
+    for (int c = 0; c < 2; c++) {
+      clamped = clamped || src.texCoord[c] < 0.0f || src.texCoord[c] > 1.0f;
+      dst.texCoord[c] = quantizeUnorm16(src.texCoord[c]);
+    }
+  }
+
+  if (clamped)
+    std::cerr << "warning: texture coordinates outside 0 to 1 were clamped, "
+                 "cook with float to keep them"
+              << std::endl;
+
+  return quantized;
+}
+
+// the post transform cache most hardware behaves like, used both to reorder
+// and to measure
+static constexpr uint32_t CACHE_SIZE = 16;
+
+struct CacheStats {
+  // misses per triangle, 0.5 at best for large regular meshes and 3 at worst
+  float acmr;
+  // misses per vertex, 1 at best
+  float atvr;
+};
+
+// simulates a fifo cache over the index buffer
+static CacheStats measureCache(const Mesh& mesh) {
+  std::vector<uint32_t> insertedAt(mesh.vertices.size(), 0);
+  std::vector<bool> used(mesh.vertices.size(), false);
+  uint32_t misses = 0, usedCount = 0;
+
+  for (uint32_t index : mesh.indices) {
+    // a vertex is cached while fewer than CACHE_SIZE misses came after it
+    if (!used[index] || misses - insertedAt[index] >= CACHE_SIZE) {
+      insertedAt[index] = misses++;
+      usedCount += used[index] ? 0 : 1;
+      used[index] = true;
+    }
+  }
+
+  return {static_cast<float>(misses) / (mesh.indices.size() / 3),
+          static_cast<float>(misses) / std::max(usedCount, 1u)};
+}
+
+// tipsify, fans around a vertex at a time and picks the next one that is
+// still in the cache and has triangles left, the positions in the result
+// where it had to jump elsewhere split it into clusters that can be reordered
+// without hurting the cache much
+static std::vector<uint32_t> optimizeVertexCache(Mesh& mesh) {
+  size_t vertexCount = mesh.vertices.size();
+  size_t triangleCount = mesh.indices.size() / 3;
+
+  // triangles of each vertex, packed
+  std::vector<uint32_t> live(vertexCount, 0);
+  for (uint32_t index : mesh.indices)
+    live[index]++;
+  std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; v++)
+    adjacencyOffsets[v + 1] = adjacencyOffsets[v] + live[v];
+  std::vector<uint32_t> adjacency(mesh.indices.size());
+  std::vector<uint32_t> filled(adjacencyOffsets.begin(),
+                               adjacencyOffsets.end() - 1);
+  for (size_t i = 0; i < mesh.indices.size(); i++)
+    adjacency[filled[mesh.indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+  std::vector<uint32_t> cacheTime(vertexCount, 0);
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<uint32_t> deadEnds;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> output;
+  std::vector<uint32_t> clusters = {0};
+  output.reserve(mesh.indices.size());
+
+  uint32_t time = CACHE_SIZE + 1;
+  uint32_t cursor = 0;
+  int64_t fan = 0;
+
+  while (fan >= 0) {
+    candidates.clear();
+    for (uint32_t a = adjacencyOffsets[fan]; a < adjacencyOffsets[fan + 1];
+         a++) {
+      uint32_t triangle = adjacency[a];
+      if (emitted[triangle])
+        continue;
+      emitted[triangle] = true;
+
+      for (uint32_t corner = 0; corner < 3; corner++) {
+        uint32_t v = mesh.indices[triangle * 3 + corner];
+        output.push_back(v);
+        deadEnds.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - cacheTime[v] > CACHE_SIZE)
+          cacheTime[v] = time++;
+      }
+    }
+
+    // the candidate that stays in the cache longest while its remaining
+    // triangles are emitted
+    fan = -1;
+    int64_t bestPriority = -1;
+    for (uint32_t v : candidates) {
+      if (live[v] == 0)
+        continue;
+      int64_t priority = 0;
+      if (time - cacheTime[v] + 2 * live[v] <= CACHE_SIZE)
+        priority = time - cacheTime[v];
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        fan = v;
+      }
+    }
+    if (fan >= 0)
+      continue;
+
+    // nothing useful is cached any more, start a new cluster from a recently
+    // used vertex or failing that the next one with triangles left
+    while (!deadEnds.empty() && fan < 0) {
+      uint32_t v = deadEnds.back();
+      deadEnds.pop_back();
+      if (live[v] > 0)
+        fan = v;
+    }
+    while (cursor < vertexCount && fan < 0) {
+      if (live[cursor] > 0)
+        fan = cursor;
+      cursor++;
+    }
+    if (fan >= 0 && output.size() / 3 > clusters.back())
+      clusters.push_back(static_cast<uint32_t>(output.size() / 3));
+  }
+
+  mesh.indices = std::move(output);
+  return clusters;
+}
+
+// clusters facing away from the middle of the mesh tend to cover the rest, so
+// drawing them first lets depth testing reject more of what comes after
+static void optimizeOverdraw(Mesh& mesh, std::vector<uint32_t> clusters) {
+  size_t triangleCount = mesh.indices.size() / 3;
+  clusters.push_back(static_cast<uint32_t>(triangleCount));
+
+  auto position = [&](uint32_t index) {
+    const float* p = mesh.vertices[mesh.indices[index]].position;
+    return std::array<double, 3>{p[0], p[1], p[2]};
+  };
+
+  std::array<double, 3> meshCenter = {0.0, 0.0, 0.0};
+  double meshArea = 0.0;
+  std::vector<std::array<double, 3>> centers, normals;
+
+  for (size_t c = 0; c + 1 < clusters.size(); c++) {
+    std::array<double, 3> center = {0.0, 0.0, 0.0};
+    std::array<double, 3> normal = {0.0, 0.0, 0.0};
+    double area = 0.0;
+
+    for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++) {
+      auto a = position(t * 3), b = position(t * 3 + 1),
+           d = position(t * 3 + 2);
+      std::array<double, 3> ab, ad, cross;
+      for (int i = 0; i < 3; i++) {
+        ab[i] = b[i] - a[i];
+        ad[i] = d[i] - a[i];
+      }
+      cross = {ab[1] * ad[2] - ab[2] * ad[1], ab[2] * ad[0] - ab[0] * ad[2],
+               ab[0] * ad[1] - ab[1] * ad[0]};
+      double triangleArea =
+          std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] +
+                    cross[2] * cross[2]) *
+          0.5;
+
+      for (int i = 0; i < 3; i++) {
+        center[i] += (a[i] + b[i] + d[i]) / 3.0 * triangleArea;
+        // cross is already weighted by area
+        normal[i] += cross[i];
+      }
+      area += triangleArea;
+    }
+
+    for (int i = 0; i < 3; i++) {
+      meshCenter[i] += center[i];
+      center[i] = area > 0.0 ? center[i] / area : 0.0;
+    }
+    meshArea += area;
+    centers.push_back(center);
+    normals.push_back(normal);
+  }
+
+  for (int i = 0; i < 3; i++)
+    meshCenter[i] = meshArea > 0.0 ? meshCenter[i] / meshArea : 0.0;
+
+  std::vector<double> sortKeys(centers.size());
+  for (size_t c = 0; c < centers.size(); c++) {
+    double length = std::sqrt(normals[c][0] * normals[c][0] +
+                              normals[c][1] * normals[c][1] +
+                              normals[c][2] * normals[c][2]);
+    for (int i = 0; i < 3; i++)
+      sortKeys[c] += (centers[c][i] - meshCenter[i]) *
+                     (length > 0.0 ? normals[c][i] / length : 0.0);
+  }
+
+  std::vector<uint32_t> order(centers.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return sortKeys[a] > sortKeys[b];
+  });
+
+  std::vector<uint32_t> sorted;
+  sorted.reserve(mesh.indices.size());
+  for (uint32_t c : order)
+    sorted.insert(sorted.end(), mesh.indices.begin() + clusters[c] * 3,
+                  mesh.indices.begin() + clusters[c + 1] * 3);
+  mesh.indices = std::move(sorted);
+}
+
+// renumbers vertices in the order the index buffer first uses them so
+// fetches walk the vertex buffer forwards, unused vertices are dropped
+static void optimizeVertexFetch(Mesh& mesh) {
+  std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+  std::vector<FloatVertex> vertices;
+  vertices.reserve(mesh.vertices.size());
+
+  for (uint32_t& index : mesh.indices) {
+    if (remap[index] == UINT32_MAX) {
+      remap[index] = static_cast<uint32_t>(vertices.size());
+      vertices.push_back(mesh.vertices[index]);
+    }
+    index = remap[index];
+  }
+
+  mesh.vertices = std::move(vertices);
+}
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// converts a wavefront obj into a mesh the engine can map without parsing,
+// usage: meshcook <input> <output> [quantized|float]
+// triangles and vertices are reordered for the vertex cache, overdraw and
+// fetch locality, indices are 16 bit whenever the vertex count allows it
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " <input> <output> [quantized|float]"
+              << std::endl;
+    return 1;
+  }
+
+  MeshVertexLayout layout = MeshVertexLayout::Quantized;
+  if (argc > 3) {
+    std::string name = argv[3];
+    if (name == "float") {
+      layout = MeshVertexLayout::Float;
+    } else if (name != "quantized") {
+      std::cerr << "unknown layout " << name << std::endl;
+      return 1;
+    }
+  }
+
+  Mesh mesh;
+  if (!loadObj(argv[1], mesh))
+    return 1;
+
+  CacheStats before = measureCache(mesh);
+  optimizeOverdraw(mesh, optimizeVertexCache(mesh));
+  optimizeVertexFetch(mesh);
+  CacheStats after = measureCache(mesh);
+
+  std::cout << std::fixed << std::setprecision(3) << "acmr " << before.acmr
+            << " -> " << after.acmr << ", atvr " << before.atvr << " -> "
+            << after.atvr << std::endl;
+
+  MeshFileHeader header;
+  header.magic = MeshFileHeader::MAGIC;
+  header.version = MeshFileHeader::VERSION;
+  header.layout = layout;
+  header.indexSize = mesh.vertices.size() <= 65536 ? 2 : 4;
+  header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+  header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+
+  for (int axis = 0; axis < 3; axis++) {
+    header.boundsMin[axis] = mesh.vertices[0].position[axis];
+    header.boundsMax[axis] = mesh.vertices[0].position[axis];
+    for (const auto& vertex : mesh.vertices) {
+      header.boundsMin[axis] =
+          std::min(header.boundsMin[axis], vertex.position[axis]);
+      header.boundsMax[axis] =
+          std::max(header.boundsMax[axis], vertex.position[axis]);
+    }
+  }
+
+  std::vector<uint8_t> vertexData;
+  if (layout == MeshVertexLayout::Float) {
+    auto bytes = reinterpret_cast<const uint8_t*>(mesh.vertices.data());
+    vertexData.assign(bytes,
+                      bytes + mesh.vertices.size() * sizeof(FloatVertex));
+  } else {
+    auto quantized = quantize(mesh, header);
+    auto bytes = reinterpret_cast<const uint8_t*>(quantized.data());
+    vertexData.assign(bytes,
+                      bytes + quantized.size() * sizeof(QuantizedVertex));
+  }
+
+  std::vector<uint8_t> indexData(mesh.indices.size() * header.indexSize);
+  if (header.indexSize == 2) {
+    for (size_t i = 0; i < mesh.indices.size(); i++) {
+      uint16_t index = static_cast<uint16_t>(mesh.indices[i]);
+      std::memcpy(&indexData[i * 2], &index, 2);
+    }
+  } else {
+    std::memcpy(indexData.data(), mesh.indices.data(), indexData.size());
+  }
+
+  header.vertexOffset = alignUp(sizeof(MeshFileHeader), 16);
+  header.indexOffset = alignUp(header.vertexOffset + vertexData.size(), 16);
+  uint64_t size = header.indexOffset + indexData.size();
+
+  std::ofstream file(argv[2], std::ios::binary);
+  if (!file) {
+    std::cerr << "failed to open " << argv[2] << std::endl;
+    return 1;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.seekp(header.vertexOffset);
+  file.write(reinterpret_cast<const char*>(vertexData.data()),
+             vertexData.size());
+  file.seekp(header.indexOffset);
+  file.write(reinterpret_cast<const char*>(indexData.data()), indexData.size());
+
+  if (!file) {
+    std::cerr << "failed to write " << argv[2] << std::endl;
+    return 1;
+  }
+
+  std::cout << argv[2] << ": " << header.vertexCount << " vertices, "
+            << header.indexCount / 3 << " triangles, "
+            << (layout == MeshVertexLayout::Float ? "float" : "quantized")
+            << ", " << header.indexSize * 8 << " bit indices, " << size
+            << " bytes" << std::endl;
+}
@@ -0,0 +1,173 @@
+#include <jobs.hpp>
+#include <pipelines.hpp>
+#include <profiler.hpp>
+#include <resources.hpp>
+
+struct PipelineStateHash {
+  size_t operator()(const PipelineState& state) const {
+    size_t hash = 0;
+    auto combine = [&hash](size_t value) {
+      hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    };
+    combine(std::hash<VkPipelineLayout>()(
+        static_cast<VkPipelineLayout>(state.layout)));
+    combine(std::hash<VkRenderPass>()(
+        static_cast<VkRenderPass>(state.renderPass)));
+    combine(static_cast<size_t>(state.colorFormat));
+    combine(static_cast<size_t>(state.depthFormat));
+    combine(static_cast<size_t>(state.depth));
+    combine(static_cast<size_t>(state.samples));
+    combine(static_cast<size_t>(state.vert));
+    combine(static_cast<size_t>(state.frag));
+    combine(state.instanced);
+    combine(static_cast<size_t>(state.vertexLayout));
+    combine(static_cast<size_t>(state.view));
+    return hash;
+  }
+};
+
+struct PipelineStateEqual {
+  bool operator()(const PipelineState& a, const PipelineState& b) const {
+    return a.layout == b.layout && a.renderPass == b.renderPass &&
+           a.colorFormat == b.colorFormat && a.depthFormat == b.depthFormat &&
+           a.depth == b.depth && a.samples == b.samples &&
+           a.vert == b.vert && a.frag == b.frag &&
+           a.instanced == b.instanced && a.vertexLayout == b.vertexLayout &&
+           a.view == b.view;
+  }
+};
+
+// what a build job hands back to the main thread
+struct BuiltPipeline {
+  PipelineHandle handle;
+  vk::Pipeline pipeline;
+  std::string error;
+};
+
+// only touched by the main thread, or read by recording jobs while it waits,
+// every pipeline in here lives until cleanupPipelines, requests that haven't
+// been built yet have a null pipeline in the pool and a fallback
+static std::unordered_map<PipelineState, PipelineHandle, PipelineStateHash,
+                          PipelineStateEqual>
+    pipelines;
+static std::unordered_map<uint32_t, PipelineHandle> fallbacks;
+
+static std::mutex builtMutex;
+static std::vector<BuiltPipeline> builtPipelines;
+static JobCounter buildJobs;
+
+// builds the pipeline right away, or returns the one that was already built
+// for the same state
+PipelineHandle buildPipeline(const PipelineState& state) {
+  auto it = pipelines.find(state);
+  if (it == pipelines.end()) {
+    PROFILE_ZONE("build pipeline");
+    PipelineHandle handle = addPipeline(buildGraphicsPipeline(state));
+    pipelines.emplace(state, handle);
+    return handle;
+  }
+
+  // requested earlier and still building
+  if (!getPipeline(it->second))
+    waitForPipelines();
+  if (!getPipeline(it->second))
+    throw std::runtime_error("failed to build pipeline");
+
+  return it->second;
+}
+
+// returns right away, the pipeline is built on a job and currentPipeline
+// returns the fallback's until it's done, the fallback has to be built
+// already and compatible with the same draws
+PipelineHandle requestPipeline(const PipelineState& state,
+                               PipelineHandle fallback) {
+  auto it = pipelines.find(state);
+  if (it != pipelines.end())
+    return it->second;
+
+  PipelineHandle handle = addPipeline(vk::Pipeline());
+  pipelines.emplace(state, handle);
+  fallbacks[handle.index] = fallback;
+
+  runBackgroundJob(
+      [state, handle] {
+        PROFILE_ZONE("build pipeline");
+        BuiltPipeline built;
+        built.handle = handle;
+        try {
+          built.pipeline = buildGraphicsPipeline(state);
+        } catch (const std::exception& e) {
+          built.error = e.what();
+        }
+
+        std::lock_guard<std::mutex> lock(builtMutex);
+        builtPipelines.push_back(std::move(built));
+      },
+      &buildJobs);
+
+  return handle;
+}
+
+// the state's pipeline for the current shading view, the textured one is its
+// fallback so that one is built right away
+PipelineHandle requestViewPipeline(PipelineState state) {
+  state.view = ShadingView::Textured;
+  PipelineHandle fallback = buildPipeline(state);
+
+  state.view = vkctx.shadingView;
+  return requestPipeline(state, fallback);
+}
+
+// the depth only pipeline drawing the same geometry as the state does in the
+// main pass, neither the fragment shader nor the view matter to it
+PipelineHandle buildPrepassPipeline(PipelineState state) {
+  state.depth = DepthMode::Prepass;
+  state.view = ShadingView::Textured;
+  if (state.renderPass)
+    state.renderPass = vkctx.depthRenderPass;
+
+  return buildPipeline(state);
+}
+
+// what to bind for the handle this frame
+vk::Pipeline currentPipeline(PipelineHandle handle) {
+  vk::Pipeline pipeline = getPipeline(handle);
+  if (pipeline)
+    return pipeline;
+
+  return getPipeline(fallbacks.at(handle.index));
+}
+
+// called once per frame, switches finished requests over from their fallback,
+// one that failed to build keeps drawing with it
+void updatePipelines() {
+  std::vector<BuiltPipeline> built;
+  {
+    std::lock_guard<std::mutex> lock(builtMutex);
+    built.swap(builtPipelines);
+  }
+
+  for (const auto& result : built) {
+    if (!result.error.empty()) {
+      std::cerr << "failed to build pipeline: " << result.error << std::endl;
+      continue;
+    }
+
+    *vkctx.pipelines.get(result.handle) = result.pipeline;
+    fallbacks.erase(result.handle.index);
+  }
+}
+
+// for when something the jobs read is about to be destroyed
+void waitForPipelines() {
+  waitForJobs(buildJobs);
+  updatePipelines();
+}
+
+void cleanupPipelines() {
+  waitForPipelines();
+  for (const auto& pipeline : pipelines)
+    destroyPipeline(pipeline.second);
+  pipelines.clear();
+  fallbacks.clear();
+}
@@ -0,0 +1,351 @@
+#include <profiler.hpp>
+
+// one finished zone, times are nanoseconds since the profiler's epoch
+struct ProfileEvent {
+  const char* name;
+  uint32_t thread;
+  int64_t start;
+  int64_t end;
+};
+
+// each thread appends to its own buffer, the lock is only ever contended
+// while profileFrame drains it
+struct ThreadEvents {
+  std::mutex mutex;
+  uint32_t id;
+  std::string name;
+  std::vector<ProfileEvent> events;
+};
+
+// a pair of timestamps, resolved once the frame or upload batch that wrote
+// them has finished
+struct GpuZone {
+  const char* name;
+  uint32_t frame;
+  uint64_t uploadId;
+  bool pending = false;
+};
+
+// frames kept for the trace and for the summary
+static constexpr uint32_t TRACE_FRAMES = 300;
+static constexpr uint32_t SUMMARY_FRAMES = 120;
+static constexpr uint32_t MAX_GPU_ZONES = 256;
+static constexpr uint32_t NO_ZONE = UINT32_MAX;
+// gpu events go into the trace as their own thread
+static constexpr uint32_t GPU_THREAD = UINT32_MAX;
+
+// set with ENGINE_PROFILE=<trace path> before starting, which also writes the
+// trace on exit
+static const char* tracePath = std::getenv("ENGINE_PROFILE");
+static std::atomic<bool> enabled{tracePath != nullptr};
+static const auto epoch = std::chrono::steady_clock::now();
+
+static std::mutex threadsMutex;
+static std::vector<std::unique_ptr<ThreadEvents>> threads;
+static thread_local ThreadEvents* localEvents = nullptr;
+
+static vk::QueryPool queryPool;
+static std::vector<GpuZone> gpuZones(MAX_GPU_ZONES);
+static uint32_t nextGpuZone = 0;
+static uint64_t timestampMask;
+// adds to gpu time in nanoseconds to get profiler time
+static int64_t gpuOffset;
+
+// every event of the last TRACE_FRAMES frames, one entry per frame
+static std::deque<std::vector<ProfileEvent>> frameEvents(1);
+// total time of each zone, one entry per frame
+static std::deque<std::map<std::pair<std::string, bool>, double>>
+    frameTotals(1);
+
+static int64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - epoch)
+      .count();
+}
+
+// timestampPeriod is in nanoseconds per tick
+static int64_t gpuNanoseconds(uint64_t ticks) {
+  return static_cast<int64_t>(static_cast<double>(ticks) *
+                              vkctx.timestampPeriod);
+}
+
+static ThreadEvents& threadEvents() {
+  if (!localEvents) {
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    threads.push_back(std::make_unique<ThreadEvents>());
+    localEvents = threads.back().get();
+    localEvents->id = static_cast<uint32_t>(threads.size() - 1);
+    localEvents->name = "thread " + std::to_string(localEvents->id);
+  }
+
+  return *localEvents;
+}
+
+ProfileZone::ProfileZone(const char* name) : name(nullptr), start(0) {
+  if (!enabled.load(std::memory_order_relaxed))
+    return;
+
+  this->name = name;
+  start = now();
+}
+
+ProfileZone::~ProfileZone() {
+  if (!name)
+    return;
+
+  int64_t end = now();
+  ThreadEvents& events = threadEvents();
+  std::lock_guard<std::mutex> lock(events.mutex);
+  events.events.push_back({name, events.id, start, end});
+}
+
+void setProfiling(bool on) { enabled.store(on, std::memory_order_relaxed); }
+
+bool profiling() { return enabled.load(std::memory_order_relaxed); }
+
+// gpu timestamps are put on the cpu timeline by reading one right after
+// the queue goes idle, that's off by the time it takes to return from the
+// wait, which is good enough to line the two up in a trace
+static void calibrateTimestamps() {
+  vk::CommandBufferAllocateInfo allocInfo(vkctx.commandPool,
+                                          vk::CommandBufferLevel::ePrimary, 1);
+  auto commandBuffer = vkctx.device.allocateCommandBuffers(allocInfo)[0];
+
+  commandBuffer.begin(vk::CommandBufferBeginInfo(
+      vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+  commandBuffer.resetQueryPool(queryPool, 0, 1);
+  commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe,
+                               queryPool, 0);
+  commandBuffer.end();
+
+  vk::SubmitInfo submitInfo(0, nullptr, nullptr, 1, &commandBuffer, 0,
+                            nullptr);
+  vkctx.graphicsQueue.submit(submitInfo, nullptr);
+  vkctx.graphicsQueue.waitIdle();
+  int64_t cpuTime = now();
+
+  uint64_t ticks = 0;
+  vkctx.device.getQueryPoolResults(
+      queryPool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks),
+      vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+  vkctx.device.freeCommandBuffers(vkctx.commandPool, commandBuffer);
+
+  gpuOffset = cpuTime - gpuNanoseconds(ticks & timestampMask);
+}
+
+// cpu zones work from the start, this sets up the queries for gpu zones,
+// which are left out if the graphics queue can't write timestamps
+void initProfiler() {
+  {
+    ThreadEvents& events = threadEvents();
+    std::lock_guard<std::mutex> lock(events.mutex);
+    events.name = "main";
+  }
+
+  uint32_t queueFamilyCount;
+  vkctx.physicalDevice.getQueueFamilyProperties(&queueFamilyCount, nullptr);
+  std::vector<vk::QueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkctx.physicalDevice.getQueueFamilyProperties(&queueFamilyCount,
+                                                queueFamilies.data());
+
+  uint32_t validBits = queueFamilies[vkctx.graphicsFamily].timestampValidBits;
+  auto limits = vkctx.physicalDevice.getProperties().limits;
+  if (validBits == 0 || limits.timestampPeriod == 0.0f) {
+    std::cerr << "timestamps aren't supported, profiling the cpu only"
+              << std::endl;
+    return;
+  }
+
+  vkctx.timestampPeriod = limits.timestampPeriod;
+  timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+  vk::QueryPoolCreateInfo info({}, vk::QueryType::eTimestamp,
+                               MAX_GPU_ZONES * 2);
+  queryPool = vkctx.device.createQueryPool(info);
+
+  calibrateTimestamps();
+}
+
+// the zone's two timestamps are reset and written from the same command
+// buffer, so it has to be outside of a render pass and on the graphics queue,
+// upload batches pass their id so the zone is read back once they finish
+uint32_t beginGpuZone(vk::CommandBuffer commandBuffer, const char* name,
+                      uint64_t uploadId) {
+  if (!queryPool || !profiling())
+    return NO_ZONE;
+
+  // the oldest zone is still in flight, drop this one
+  uint32_t zone = nextGpuZone;
+  if (gpuZones[zone].pending)
+    return NO_ZONE;
+  nextGpuZone = (nextGpuZone + 1) % MAX_GPU_ZONES;
+
+  gpuZones[zone] = {name, vkctx.currentFrame, uploadId, true};
+
+  commandBuffer.resetQueryPool(queryPool, zone * 2, 2);
+  commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe,
+                               queryPool, zone * 2);
+
+  return zone;
+}
+
+void endGpuZone(vk::CommandBuffer commandBuffer, uint32_t zone) {
+  if (zone == NO_ZONE)
+    return;
+
+  commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe,
+                               queryPool, zone * 2 + 1);
+}
+
+static void addEvent(const ProfileEvent& event, bool gpu) {
+  frameEvents.back().push_back(event);
+  frameTotals.back()[{event.name, gpu}] += (event.end - event.start) / 1e6;
+}
+
+static void resolveGpuZone(uint32_t zone) {
+  std::array<uint64_t, 2> ticks;
+  vk::Result result = vkctx.device.getQueryPoolResults(
+      queryPool, zone * 2, 2, sizeof(ticks), ticks.data(), sizeof(uint64_t),
+      vk::QueryResultFlagBits::e64);
+  gpuZones[zone].pending = false;
+
+  if (result != vk::Result::eSuccess)
+    return;
+
+  int64_t start = gpuOffset + gpuNanoseconds(ticks[0] & timestampMask);
+  int64_t duration = gpuNanoseconds((ticks[1] - ticks[0]) & timestampMask);
+  addEvent({gpuZones[zone].name, GPU_THREAD, start, start + duration}, true);
+}
+
+// called once the frame slot's fence has signalled, collects what every
+// thread recorded since the last call and the gpu zones that have finished,
+// then starts the next frame of the trace and summary
+void profileFrame(uint32_t frame) {
+  {
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    for (auto& thread : threads) {
+      std::lock_guard<std::mutex> threadLock(thread->mutex);
+      for (const auto& event : thread->events)
+        addEvent(event, false);
+      thread->events.clear();
+    }
+  }
+
+  if (queryPool) {
+    for (uint32_t zone = 0; zone < MAX_GPU_ZONES; zone++) {
+      const GpuZone& gpuZone = gpuZones[zone];
+      if (!gpuZone.pending)
+        continue;
+
+      bool finished = gpuZone.uploadId
+                          ? gpuZone.uploadId <= vkctx.completedUploadId
+                          : gpuZone.frame == frame;
+      if (finished)
+        resolveGpuZone(zone);
+    }
+  }
+
+  frameEvents.emplace_back();
+  if (frameEvents.size() > TRACE_FRAMES)
+    frameEvents.pop_front();
+
+  frameTotals.emplace_back();
+  if (frameTotals.size() > SUMMARY_FRAMES)
+    frameTotals.pop_front();
+}
+
+// the frame still being collected is left out
+std::vector<ProfileStat> profileSummary() {
+  std::map<std::pair<std::string, bool>, ProfileStat> stats;
+  size_t frames = frameTotals.size() - 1;
+
+  for (size_t i = 0; i < frames; i++) {
+    for (const auto& [key, total] : frameTotals[i]) {
+      ProfileStat& stat = stats[key];
+      stat.name = key.first;
+      stat.gpu = key.second;
+      stat.mean += total / frames;
+      stat.max = std::max(stat.max, total);
+    }
+  }
+
+  std::vector<ProfileStat> summary;
+  for (const auto& [key, stat] : stats)
+    summary.push_back(stat);
+
+  return summary;
+}
+
+static void writeJsonString(std::ostream& out, const std::string& value) {
+  out << '"';
+  for (char c : value) {
+    if (c == '"' || c == '\\')
+      out << '\\' << c;
+    else if (static_cast<unsigned char>(c) < 0x20)
+      out << ' ';
+    else
+      out << c;
+  }
+  out << '"';
+}
+
+// chrome's trace event format, open it in chrome://tracing or perfetto, cpu
+// threads and the gpu show up as two processes
+bool writeProfileTrace(const std::string& path) {
+  std::ofstream file(path);
+  if (!file)
+    return false;
+
+  file << std::fixed << std::setprecision(3);
+  file << "{\"traceEvents\": [" << std::endl;
+  file << "{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": 0, "
+          "\"args\": {\"name\": \"cpu\"}},"
+       << std::endl;
+  file << "{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": 1, "
+          "\"args\": {\"name\": \"gpu\"}}";
+
+  {
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    for (const auto& thread : threads) {
+      file << "," << std::endl
+           << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 0, "
+           << "\"tid\": " << thread->id << ", \"args\": {\"name\": ";
+      writeJsonString(file, thread->name);
+      file << "}}";
+    }
+  }
+
+  for (const auto& events : frameEvents) {
+    for (const auto& event : events) {
+      bool gpu = event.thread == GPU_THREAD;
+      file << "," << std::endl << "{\"ph\": \"X\", \"name\": ";
+      writeJsonString(file, event.name);
+      file << ", \"pid\": " << (gpu ? 1 : 0)
+           << ", \"tid\": " << (gpu ? 0 : event.thread)
+           << ", \"ts\": " << event.start / 1e3
+           << ", \"dur\": " << (event.end - event.start) / 1e3 << "}";
+    }
+  }
+
+  file << std::endl << "]}" << std::endl;
+
+  return static_cast<bool>(file);
+}
+
+// the device has to be idle, everything still pending is read back before
+// the trace is written
+void cleanupProfiler() {
+  if (queryPool) {
+    for (uint32_t zone = 0; zone < MAX_GPU_ZONES; zone++)
+      if (gpuZones[zone].pending)
+        resolveGpuZone(zone);
+  }
+
+  if (tracePath && !writeProfileTrace(tracePath))
+    std::cerr << "failed to write profile trace to " << tracePath
+              << std::endl;
+
+  if (queryPool)
+    vkctx.device.destroyQueryPool(queryPool);
+  queryPool = nullptr;
+}
@@ -0,0 +1,148 @@
+#include <pipelines.hpp>
+#include <profiler.hpp>
+#include <record.hpp>
+#include <resources.hpp>
+
+// each chunk of the draw list gets its own pool, so no two jobs ever record
+// from the same pool at the same time, the prepass' chunks have their own
+static void recordSecondary(uint32_t chunk, uint32_t first, uint32_t last,
+                            uint32_t imageIndex, bool prepass) {
+  PROFILE_ZONE("record chunk");
+  uint32_t pool = prepass ? vkctx.recordThreads + chunk : chunk;
+  // the frame's fence has signalled so nothing from this pool is in use
+  vkctx.device.resetCommandPool(vkctx.recordPools[vkctx.currentFrame][pool],
+                                static_cast<vk::CommandPoolResetFlags>(0));
+
+  const auto& buffer = vkctx.recordBuffers[vkctx.currentFrame][pool];
+  const Mesh& mesh = getMesh(vkctx.sceneMesh);
+
+  // with dynamic rendering there's no render pass to inherit, only the
+  // attachment formats and sample count, the main pass runs inside the
+  // overdraw query
+  vk::CommandBufferInheritanceInfo inheritanceInfo;
+  vk::CommandBufferInheritanceRenderingInfoKHR renderingInfo(
+      {}, 0, prepass ? 0 : 1, &vkctx.swapchainImageFormat, vkctx.depthFormat,
+      vk::Format::eUndefined, vkctx.samples);
+  if (vkctx.dynamicRendering)
+    inheritanceInfo.pNext = &renderingInfo;
+  else if (prepass)
+    inheritanceInfo = vk::CommandBufferInheritanceInfo(
+        vkctx.depthRenderPass, 0, vkctx.depthFramebuffer);
+  else
+    inheritanceInfo = vk::CommandBufferInheritanceInfo(
+        vkctx.renderPass, 0, vkctx.framebuffers[imageIndex]);
+  if (vkctx.overdrawStats && !prepass)
+    inheritanceInfo.pipelineStatistics =
+        vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations;
+  vk::CommandBufferBeginInfo beginInfo(
+      vk::CommandBufferUsageFlagBits::eOneTimeSubmit |
+          vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+      &inheritanceInfo);
+  buffer.begin(beginInfo);
+
+  // secondary command buffers don't inherit any state from the primary
+  PipelineHandle pipeline = vkctx.instanced ? vkctx.instancedPipeline
+                                            : vkctx.pipeline;
+  buffer.bindPipeline(
+      vk::PipelineBindPoint::eGraphics,
+      currentPipeline(prepass ? vkctx.prepassPipeline : pipeline));
+
+  vk::Viewport viewport(0.0f, 0.0f,
+                        static_cast<float>(vkctx.swapchainExtent.width),
+                        static_cast<float>(vkctx.swapchainExtent.height),
+                        0.0f, 1.0f);
+
+  vk::Rect2D scissor({0, 0}, vkctx.swapchainExtent);
+
+  buffer.setScissor(0, 1, &scissor);
+  buffer.setViewport(0, 1, &viewport);
+  buffer.bindVertexBuffers(
+      0, std::array<vk::Buffer, 1>({getBuffer(mesh.vertexBuffer).buffer}),
+      {0});
+  if (vkctx.instanced)
+    buffer.bindVertexBuffers(
+        1,
+        std::array<vk::Buffer, 1>(
+            {vkctx.instanceBuffers[vkctx.currentFrame]}),
+        {0});
+  buffer.bindIndexBuffer(getBuffer(mesh.indexBuffer).buffer, 0,
+                         mesh.indexType);
+
+  // every texture is in the one set, draws only push their slot
+  if (vkctx.bindless)
+    buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                              vkctx.pipelineLayout, 1, 1, &vkctx.textureSet, 0,
+                              nullptr);
+
+  for (uint32_t i = first; i < last; i++) {
+    const auto& draw = vkctx.draws[i];
+    buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                              vkctx.pipelineLayout, 0, 1,
+                              &vkctx.descriptorSets[vkctx.currentFrame], 1,
+                              &draw.uniformOffset);
+    // instanced draws take their texture from the instance stream
+    if (vkctx.bindless && !vkctx.instanced)
+      buffer.pushConstants(vkctx.pipelineLayout,
+                           vk::ShaderStageFlagBits::eFragment, 0,
+                           sizeof(uint32_t), &draw.textureSlot);
+    buffer.drawIndexed(draw.indexCount, draw.instanceCount, draw.firstIndex,
+                       draw.vertexOffset, draw.firstInstance);
+  }
+
+  buffer.end();
+}
+
+void initRecording() {
+  vkctx.recordThreads = jobThreadCount();
+
+  vk::CommandPoolCreateInfo poolInfo(
+      vk::CommandPoolCreateFlagBits::eTransient, vkctx.graphicsFamily);
+
+  vkctx.recordPools.resize(vkctx.framesInFlight);
+  vkctx.recordBuffers.resize(vkctx.framesInFlight);
+
+  for (uint32_t frame = 0; frame < vkctx.framesInFlight; frame++) {
+    for (uint32_t chunk = 0; chunk < vkctx.recordThreads * 2; chunk++) {
+      auto pool = vkctx.device.createCommandPool(poolInfo);
+
+      vk::CommandBufferAllocateInfo allocInfo(
+          pool, vk::CommandBufferLevel::eSecondary, 1);
+
+      vkctx.recordPools[frame].push_back(pool);
+      vkctx.recordBuffers[frame].push_back(
+          vkctx.device.allocateCommandBuffers(allocInfo)[0]);
+    }
+  }
+}
+
+void cleanupRecording() {
+  for (const auto& pools : vkctx.recordPools) {
+    for (const auto& pool : pools)
+      vkctx.device.destroyCommandPool(pool);
+  }
+  vkctx.recordPools.clear();
+  vkctx.recordBuffers.clear();
+}
+
+// records vkctx.draws into secondary command buffers as jobs and executes
+// them from the primary, which has to be inside a render pass begun with
+// eSecondaryCommandBuffers, the depth prepass' or the main one
+void recordDraws(vk::CommandBuffer primary, uint32_t imageIndex,
+                 bool prepass) {
+  uint32_t drawCount = static_cast<uint32_t>(vkctx.draws.size());
+
+  // small draw lists aren't worth splitting up
+  uint32_t chunks = std::clamp<uint32_t>(
+      (drawCount + vkctx.MIN_DRAWS_PER_THREAD - 1) / vkctx.MIN_DRAWS_PER_THREAD,
+      1, vkctx.recordThreads);
+
+  parallelFor(drawCount, chunks,
+              [imageIndex, prepass](uint32_t chunk, uint32_t first,
+                                    uint32_t last) {
+                recordSecondary(chunk, first, last, imageIndex, prepass);
+              });
+
+  primary.executeCommands(
+      chunks, vkctx.recordBuffers[vkctx.currentFrame].data() +
+                  (prepass ? vkctx.recordThreads : 0));
+}
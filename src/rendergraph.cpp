@@ -0,0 +1,513 @@
+#include <profiler.hpp>
+#include <rendergraph.hpp>
+#include <resources.hpp>
+
+struct AccessInfo {
+  vk::PipelineStageFlags stage;
+  vk::AccessFlags access;
+  // undefined for accesses that don't care, like buffer ones
+  vk::ImageLayout layout;
+  bool write;
+};
+
+// what a resource's state looks like while walking the passes, a write has to
+// wait for the last write and every read since, a read only has to see the
+// last write once per stage
+struct ResourceState {
+  vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+  vk::PipelineStageFlags writeStage;
+  vk::AccessFlags writeAccess;
+  vk::PipelineStageFlags readStages;
+  vk::PipelineStageFlags visibleStages;
+  vk::AccessFlags visibleAccess;
+};
+
+static const vk::AccessFlags WRITE_ACCESS =
+    vk::AccessFlagBits::eShaderWrite |
+    vk::AccessFlagBits::eColorAttachmentWrite |
+    vk::AccessFlagBits::eDepthStencilAttachmentWrite |
+    vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eHostWrite |
+    vk::AccessFlagBits::eMemoryWrite;
+
+static AccessInfo accessInfo(GraphAccess access) {
+  using Stage = vk::PipelineStageFlagBits;
+  using Access = vk::AccessFlagBits;
+  using Layout = vk::ImageLayout;
+
+  switch (access) {
+  case GraphAccess::None:
+    return {{}, {}, Layout::eUndefined, false};
+  case GraphAccess::Acquire:
+    return {Stage::eColorAttachmentOutput, {}, Layout::eUndefined, false};
+  case GraphAccess::Present:
+    return {Stage::eBottomOfPipe, {}, Layout::ePresentSrcKHR, false};
+  case GraphAccess::ColorAttachment:
+    return {Stage::eColorAttachmentOutput,
+            Access::eColorAttachmentRead | Access::eColorAttachmentWrite,
+            Layout::eColorAttachmentOptimal, true};
+  case GraphAccess::DepthAttachment:
+    return {Stage::eEarlyFragmentTests | Stage::eLateFragmentTests,
+            Access::eDepthStencilAttachmentRead |
+                Access::eDepthStencilAttachmentWrite,
+            Layout::eDepthStencilAttachmentOptimal, true};
+  case GraphAccess::DepthRead:
+    return {Stage::eEarlyFragmentTests | Stage::eLateFragmentTests,
+            Access::eDepthStencilAttachmentRead,
+            Layout::eDepthStencilReadOnlyOptimal, false};
+  case GraphAccess::Sampled:
+    return {Stage::eFragmentShader, Access::eShaderRead,
+            Layout::eShaderReadOnlyOptimal, false};
+  case GraphAccess::ComputeRead:
+    return {Stage::eComputeShader, Access::eShaderRead, Layout::eGeneral,
+            false};
+  case GraphAccess::ComputeWrite:
+    return {Stage::eComputeShader, Access::eShaderRead | Access::eShaderWrite,
+            Layout::eGeneral, true};
+  case GraphAccess::TransferRead:
+    return {Stage::eTransfer, Access::eTransferRead,
+            Layout::eTransferSrcOptimal, false};
+  case GraphAccess::TransferWrite:
+    return {Stage::eTransfer, Access::eTransferWrite,
+            Layout::eTransferDstOptimal, true};
+  case GraphAccess::IndirectRead:
+    return {Stage::eDrawIndirect, Access::eIndirectCommandRead,
+            Layout::eUndefined, false};
+  }
+
+  throw std::invalid_argument("unknown graph access");
+}
+
+static vk::ImageUsageFlags accessUsage(GraphAccess access) {
+  switch (access) {
+  case GraphAccess::ColorAttachment:
+    return vk::ImageUsageFlagBits::eColorAttachment;
+  case GraphAccess::DepthAttachment:
+  case GraphAccess::DepthRead:
+    return vk::ImageUsageFlagBits::eDepthStencilAttachment;
+  case GraphAccess::Sampled:
+    return vk::ImageUsageFlagBits::eSampled;
+  case GraphAccess::ComputeRead:
+  case GraphAccess::ComputeWrite:
+    return vk::ImageUsageFlagBits::eStorage;
+  case GraphAccess::TransferRead:
+    return vk::ImageUsageFlagBits::eTransferSrc;
+  case GraphAccess::TransferWrite:
+    return vk::ImageUsageFlagBits::eTransferDst;
+  default:
+    return {};
+  }
+}
+
+static vk::ImageAspectFlags formatAspect(vk::Format format) {
+  switch (format) {
+  case vk::Format::eD16Unorm:
+  case vk::Format::eX8D24UnormPack32:
+  case vk::Format::eD32Sfloat:
+    return vk::ImageAspectFlagBits::eDepth;
+  case vk::Format::eD16UnormS8Uint:
+  case vk::Format::eD24UnormS8Uint:
+  case vk::Format::eD32SfloatS8Uint:
+    return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+  default:
+    return vk::ImageAspectFlagBits::eColor;
+  }
+}
+
+// images that are only ever attachments never have to leave the tile on
+// devices that render in tiles, so they don't need real memory behind them
+static bool attachmentOnly(vk::ImageUsageFlags usage) {
+  vk::ImageUsageFlags attachments =
+      vk::ImageUsageFlagBits::eColorAttachment |
+      vk::ImageUsageFlagBits::eDepthStencilAttachment |
+      vk::ImageUsageFlagBits::eInputAttachment;
+  return usage && !(usage & ~attachments);
+}
+
+static bool hasLazyMemory(uint32_t memoryTypeBits) {
+  auto props = vkctx.physicalDevice.getMemoryProperties();
+  for (uint32_t i = 0; i < props.memoryTypeCount; i++) {
+    if ((memoryTypeBits & (1u << i)) &&
+        (props.memoryTypes[i].propertyFlags &
+         vk::MemoryPropertyFlagBits::eLazilyAllocated))
+      return true;
+  }
+
+  return false;
+}
+
+// the state an imported resource is in before the first pass, whatever
+// happened to it counts as a write the first pass has to wait for
+static ResourceState initialState(GraphAccess access) {
+  AccessInfo info = accessInfo(access);
+
+  ResourceState state;
+  state.layout = info.layout;
+  state.writeStage = info.stage;
+  state.writeAccess = info.access & WRITE_ACCESS;
+
+  return state;
+}
+
+// adds whatever has to happen before access to the pass's barrier, a layout
+// transition counts as a write of its own
+static void useResource(const GraphResource& resource, uint32_t index,
+                        GraphAccess access, ResourceState& state,
+                        GraphBarrier& barrier) {
+  AccessInfo info = accessInfo(access);
+  bool transition = resource.isImage &&
+                    info.layout != vk::ImageLayout::eUndefined &&
+                    info.layout != state.layout;
+
+  if (transition) {
+    barrier.srcStage |= state.writeStage | state.readStages;
+    barrier.dstStage |= info.stage;
+    barrier.images.push_back(
+        {index, state.writeAccess, info.access, state.layout, info.layout});
+    state.layout = info.layout;
+  } else if (info.write) {
+    vk::PipelineStageFlags wait = state.writeStage | state.readStages;
+    if (wait) {
+      barrier.srcStage |= wait;
+      barrier.srcAccess |= state.writeAccess;
+      barrier.dstStage |= info.stage;
+      barrier.dstAccess |= info.access;
+    }
+  } else {
+    bool visible = (state.visibleStages & info.stage) == info.stage &&
+                   (state.visibleAccess & info.access) == info.access;
+    if (state.writeStage && !visible) {
+      barrier.srcStage |= state.writeStage;
+      barrier.srcAccess |= state.writeAccess;
+      barrier.dstStage |= info.stage;
+      barrier.dstAccess |= info.access;
+    }
+
+    state.readStages |= info.stage;
+    state.visibleStages |= info.stage;
+    state.visibleAccess |= info.access;
+    return;
+  }
+
+  state.writeStage = info.stage;
+  state.writeAccess = info.access & WRITE_ACCESS;
+  state.readStages = info.write ? vk::PipelineStageFlags() : info.stage;
+  state.visibleStages = info.stage;
+  state.visibleAccess = info.access;
+}
+
+// walks the passes that weren't culled from the given states, returns the
+// states they're left in
+static std::vector<ResourceState>
+buildBarriers(RenderGraph& graph, std::vector<ResourceState> states) {
+  graph.barriers.assign(graph.passes.size() + 1, GraphBarrier());
+
+  for (size_t i = 0; i < graph.passes.size(); i++) {
+    if (graph.passes[i].culled)
+      continue;
+
+    for (const auto& use : graph.passes[i].uses)
+      useResource(graph.resources[use.resource], use.resource, use.access,
+                  states[use.resource], graph.barriers[i]);
+  }
+
+  for (uint32_t i = 0; i < graph.resources.size(); i++) {
+    if (graph.resources[i].final != GraphAccess::None)
+      useResource(graph.resources[i], i, graph.resources[i].final, states[i],
+                  graph.barriers.back());
+  }
+
+  return states;
+}
+
+// a pass is kept if it writes something a later kept pass uses or that's an
+// output of the graph
+static void cullPasses(RenderGraph& graph) {
+  std::vector<bool> needed(graph.resources.size());
+  for (size_t i = 0; i < graph.resources.size(); i++)
+    needed[i] = graph.resources[i].final != GraphAccess::None;
+
+  for (size_t i = graph.passes.size(); i-- > 0;) {
+    GraphPass& pass = graph.passes[i];
+
+    pass.culled = true;
+    for (const auto& use : pass.uses) {
+      if (accessInfo(use.access).write && needed[use.resource])
+        pass.culled = false;
+    }
+
+    if (!pass.culled) {
+      for (const auto& use : pass.uses)
+        needed[use.resource] = true;
+    }
+  }
+}
+
+// transients whose passes don't overlap are bound to the same allocation,
+// attachment only ones are transient attachments in lazily allocated memory
+// where the device has it and only share with each other, returns the images
+// in each allocation in the order they're used
+static std::vector<std::vector<uint32_t>> createTransients(RenderGraph& graph) {
+  size_t count = graph.resources.size();
+  std::vector<size_t> first(count, SIZE_MAX), last(count, 0);
+  std::vector<vk::ImageUsageFlags> usage(count);
+
+  for (size_t i = 0; i < graph.passes.size(); i++) {
+    if (graph.passes[i].culled)
+      continue;
+
+    for (const auto& use : graph.passes[i].uses) {
+      first[use.resource] = std::min(first[use.resource], i);
+      last[use.resource] = i;
+      usage[use.resource] |= accessUsage(use.access);
+    }
+  }
+
+  std::vector<uint32_t> order;
+  for (uint32_t i = 0; i < count; i++) {
+    if (graph.resources[i].transient && first[i] != SIZE_MAX)
+      order.push_back(i);
+  }
+  std::sort(order.begin(), order.end(),
+            [&](uint32_t a, uint32_t b) { return first[a] < first[b]; });
+
+  std::vector<vk::MemoryRequirements> requirements;
+  std::vector<size_t> memoryEnd;
+  std::vector<bool> memoryLazy;
+  std::vector<std::vector<uint32_t>> occupants;
+
+  for (uint32_t index : order) {
+    GraphResource& resource = graph.resources[index];
+    bool lazy = attachmentOnly(usage[index]);
+    if (lazy)
+      usage[index] |= vk::ImageUsageFlagBits::eTransientAttachment;
+
+    vk::ImageCreateInfo info(
+        {}, vk::ImageType::e2D, resource.format,
+        vk::Extent3D(resource.extent.width, resource.extent.height, 1), 1, 1,
+        resource.samples, vk::ImageTiling::eOptimal, usage[index],
+        vk::SharingMode::eExclusive);
+    resource.image = vkctx.device.createImage(info);
+    auto imageRequirements =
+        vkctx.device.getImageMemoryRequirements(resource.image);
+
+    uint32_t memory = 0;
+    while (memory < occupants.size() &&
+           (memoryEnd[memory] >= first[index] || memoryLazy[memory] != lazy ||
+            !(requirements[memory].memoryTypeBits &
+              imageRequirements.memoryTypeBits)))
+      memory++;
+
+    if (memory == occupants.size()) {
+      requirements.push_back(imageRequirements);
+      memoryEnd.push_back(0);
+      memoryLazy.push_back(lazy);
+      occupants.emplace_back();
+    } else {
+      auto& shared = requirements[memory];
+      shared.size = std::max(shared.size, imageRequirements.size);
+      shared.alignment =
+          std::max(shared.alignment, imageRequirements.alignment);
+      shared.memoryTypeBits &= imageRequirements.memoryTypeBits;
+    }
+
+    memoryEnd[memory] = last[index];
+    occupants[memory].push_back(index);
+    resource.memory = memory;
+  }
+
+  for (size_t memory = 0; memory < occupants.size(); memory++) {
+    bool lazy = memoryLazy[memory] &&
+                hasLazyMemory(requirements[memory].memoryTypeBits);
+
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = lazy ? VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED
+                           : VMA_MEMORY_USAGE_GPU_ONLY;
+
+    VkMemoryRequirements memoryRequirements = requirements[memory];
+    VmaAllocation allocation;
+    if (vmaAllocateMemory(vkctx.allocator, &memoryRequirements, &allocInfo,
+                          &allocation, nullptr) != VK_SUCCESS)
+      throw std::runtime_error("failed to allocate transient attachments");
+    graph.memory.push_back(allocation);
+
+    for (uint32_t index : occupants[memory]) {
+      GraphResource& resource = graph.resources[index];
+      vmaBindImageMemory(vkctx.allocator, allocation, resource.image);
+
+      vk::ImageViewCreateInfo viewInfo(
+          {}, resource.image, vk::ImageViewType::e2D, resource.format, {},
+          vk::ImageSubresourceRange(formatAspect(resource.format), 0, 1, 0,
+                                    1));
+      resource.view = vkctx.device.createImageView(viewInfo);
+    }
+  }
+
+  return occupants;
+}
+
+uint32_t importGraphImage(RenderGraph& graph, const char* name,
+                          GraphAccess initial, GraphAccess final) {
+  GraphResource resource;
+  resource.name = name;
+  resource.isImage = true;
+  resource.initial = initial;
+  resource.final = final;
+  graph.resources.push_back(resource);
+
+  return static_cast<uint32_t>(graph.resources.size() - 1);
+}
+
+uint32_t importGraphBuffer(RenderGraph& graph, const char* name,
+                           GraphAccess initial, GraphAccess final) {
+  GraphResource resource;
+  resource.name = name;
+  resource.isImage = false;
+  resource.initial = initial;
+  resource.final = final;
+  graph.resources.push_back(resource);
+
+  return static_cast<uint32_t>(graph.resources.size() - 1);
+}
+
+// its usage is whatever the passes using it need, its contents don't survive
+// from one frame to the next
+uint32_t addGraphImage(RenderGraph& graph, const char* name, vk::Format format,
+                       vk::Extent2D extent, vk::SampleCountFlagBits samples) {
+  GraphResource resource;
+  resource.name = name;
+  resource.isImage = true;
+  resource.transient = true;
+  resource.format = format;
+  resource.extent = extent;
+  resource.samples = samples;
+  graph.resources.push_back(resource);
+
+  return static_cast<uint32_t>(graph.resources.size() - 1);
+}
+
+void addGraphPass(RenderGraph& graph, const char* name,
+                  std::vector<GraphUse> uses,
+                  std::function<void(vk::CommandBuffer)> record) {
+  GraphPass pass;
+  pass.name = name;
+  pass.uses = std::move(uses);
+  pass.record = std::move(record);
+  graph.passes.push_back(std::move(pass));
+}
+
+// imported images are always color images
+void bindGraphImage(RenderGraph& graph, uint32_t resource, vk::Image image,
+                    vk::ImageView view) {
+  graph.resources[resource].image = image;
+  graph.resources[resource].view = view;
+}
+
+void bindGraphBuffer(RenderGraph& graph, uint32_t resource,
+                     vk::Buffer buffer) {
+  graph.resources[resource].buffer = buffer;
+}
+
+// null for transients no pass that's kept uses
+vk::ImageView graphImageView(const RenderGraph& graph, uint32_t resource) {
+  return graph.resources[resource].view;
+}
+
+void compileGraph(RenderGraph& graph) {
+  cullPasses(graph);
+  auto occupants = createTransients(graph);
+
+  std::vector<ResourceState> states(graph.resources.size());
+  for (size_t i = 0; i < graph.resources.size(); i++) {
+    if (!graph.resources[i].transient)
+      states[i] = initialState(graph.resources[i].initial);
+  }
+
+  // a transient's first use has to wait for the image that used its memory
+  // before it, for the first one that's the last one from the previous frame,
+  // the states at the end don't depend on that so one walk finds them
+  auto end = buildBarriers(graph, states);
+  for (const auto& images : occupants) {
+    for (size_t i = 0; i < images.size(); i++) {
+      uint32_t previous = images[(i + images.size() - 1) % images.size()];
+      states[images[i]].writeStage =
+          end[previous].writeStage | end[previous].readStages;
+      states[images[i]].writeAccess = end[previous].writeAccess;
+    }
+  }
+  buildBarriers(graph, states);
+
+  graph.compiled = true;
+}
+
+static void recordBarrier(const RenderGraph& graph,
+                          const GraphBarrier& barrier,
+                          vk::CommandBuffer commandBuffer) {
+  if (!barrier.dstStage)
+    return;
+
+  std::vector<vk::ImageMemoryBarrier> images;
+  for (const auto& image : barrier.images) {
+    const GraphResource& resource = graph.resources[image.resource];
+    vk::ImageAspectFlags aspect = resource.transient
+                                      ? formatAspect(resource.format)
+                                      : vk::ImageAspectFlagBits::eColor;
+
+    images.emplace_back(image.srcAccess, image.dstAccess, image.oldLayout,
+                        image.newLayout, VK_QUEUE_FAMILY_IGNORED,
+                        VK_QUEUE_FAMILY_IGNORED, resource.image,
+                        vk::ImageSubresourceRange(aspect, 0, 1, 0, 1));
+  }
+
+  // nothing to wait for, the barrier is only there for a layout transition
+  vk::PipelineStageFlags srcStage =
+      barrier.srcStage ? barrier.srcStage
+                       : vk::PipelineStageFlags(
+                             vk::PipelineStageFlagBits::eTopOfPipe);
+  vk::MemoryBarrier memoryBarrier(barrier.srcAccess, barrier.dstAccess);
+  bool global = barrier.srcAccess || barrier.dstAccess;
+
+  commandBuffer.pipelineBarrier(
+      srcStage, barrier.dstStage, static_cast<vk::DependencyFlags>(0),
+      global ? 1 : 0, &memoryBarrier, 0, nullptr,
+      static_cast<uint32_t>(images.size()), images.data());
+}
+
+// every imported resource a kept pass uses has to be bound first
+void executeGraph(RenderGraph& graph, vk::CommandBuffer commandBuffer) {
+  if (!graph.compiled)
+    throw std::runtime_error("render graph wasn't compiled");
+
+  for (size_t i = 0; i < graph.passes.size(); i++) {
+    const GraphPass& pass = graph.passes[i];
+    if (pass.culled)
+      continue;
+
+    recordBarrier(graph, graph.barriers[i], commandBuffer);
+
+    uint32_t zone = beginGpuZone(commandBuffer, pass.name);
+    pass.record(commandBuffer);
+    endGpuZone(commandBuffer, zone);
+  }
+
+  recordBarrier(graph, graph.barriers.back(), commandBuffer);
+}
+
+// frames in flight might still be using the transients
+void destroyGraph(RenderGraph& graph) {
+  std::vector<std::pair<vk::Image, vk::ImageView>> images;
+  for (const auto& resource : graph.resources) {
+    if (resource.transient && resource.image)
+      images.emplace_back(resource.image, resource.view);
+  }
+
+  deferDestroy([images, memory = graph.memory] {
+    for (const auto& image : images) {
+      vkctx.device.destroyImageView(image.second);
+      vkctx.device.destroyImage(image.first);
+    }
+    for (auto allocation : memory)
+      vmaFreeMemory(vkctx.allocator, allocation);
+  });
+
+  graph = RenderGraph();
+}
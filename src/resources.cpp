@@ -0,0 +1,153 @@
+#include <image.hpp>
+#include <resources.hpp>
+
+// destroys waiting for the frames that might still use what they destroy,
+// tagged with the frameNumber they were queued in
+static std::deque<std::pair<uint64_t, std::function<void()>>> pendingDestroys;
+
+template <typename T>
+static T& lookup(HandlePool<T>& pool, Handle<T> handle, const char* kind) {
+  T* item = pool.get(handle);
+  if (!item)
+    throw std::runtime_error(std::string("stale ") + kind + " handle");
+
+  return *item;
+}
+
+// the handle stops working right away, the slot is only given out again once
+// the item is destroyed so nothing in flight sees its index, like a bindless
+// texture slot, refer to something else
+template <typename T, typename F>
+static void retire(HandlePool<T>& pool, Handle<T> handle, F destroy) {
+  T item = pool.remove(handle);
+  uint32_t slot = handle.index;
+
+  deferDestroy([&pool, item, slot, destroy]() mutable {
+    destroy(item);
+    pool.release(slot);
+  });
+}
+
+BufferHandle addBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage,
+                       vk::MemoryPropertyFlags props, VmaMemoryUsage memUsage) {
+  GpuBuffer buffer;
+  buffer.size = size;
+  buffer.buffer = createBuffer(size, usage, props, memUsage, buffer.allocation);
+
+  return vkctx.buffers.add(buffer);
+}
+
+const GpuBuffer& getBuffer(BufferHandle handle) {
+  return lookup(vkctx.buffers, handle, "buffer");
+}
+
+void destroyBuffer(BufferHandle handle) {
+  retire(vkctx.buffers, handle, [](GpuBuffer& buffer) {
+    vmaDestroyBuffer(vkctx.allocator, buffer.buffer, buffer.allocation);
+  });
+}
+
+// the texture may still be empty, streamed textures are added before they're
+// loaded
+ImageHandle addImage(const Texture& texture) {
+  return vkctx.images.add(texture);
+}
+
+Texture& getImage(ImageHandle handle) {
+  return lookup(vkctx.images, handle, "image");
+}
+
+void destroyImage(ImageHandle handle) {
+  retire(vkctx.images, handle, [](Texture& texture) {
+    if (texture.image)
+      destroyTexture(texture);
+  });
+}
+
+SamplerHandle addSampler(const vk::SamplerCreateInfo& info) {
+  return vkctx.samplers.add(vkctx.device.createSampler(info));
+}
+
+vk::Sampler getSampler(SamplerHandle handle) {
+  return lookup(vkctx.samplers, handle, "sampler");
+}
+
+void destroySampler(SamplerHandle handle) {
+  retire(vkctx.samplers, handle,
+         [](vk::Sampler sampler) { vkctx.device.destroySampler(sampler); });
+}
+
+PipelineHandle addPipeline(vk::Pipeline pipeline) {
+  return vkctx.pipelines.add(pipeline);
+}
+
+vk::Pipeline getPipeline(PipelineHandle handle) {
+  return lookup(vkctx.pipelines, handle, "pipeline");
+}
+
+void destroyPipeline(PipelineHandle handle) {
+  retire(vkctx.pipelines, handle,
+         [](vk::Pipeline pipeline) { vkctx.device.destroyPipeline(pipeline); });
+}
+
+// the mesh owns its buffers, they're destroyed along with it
+MeshHandle addMesh(const Mesh& mesh) { return vkctx.meshes.add(mesh); }
+
+const Mesh& getMesh(MeshHandle handle) {
+  return lookup(vkctx.meshes, handle, "mesh");
+}
+
+void destroyMesh(MeshHandle handle) {
+  const Mesh& mesh = getMesh(handle);
+  if (vkctx.buffers.contains(mesh.vertexBuffer))
+    destroyBuffer(mesh.vertexBuffer);
+  if (vkctx.buffers.contains(mesh.indexBuffer))
+    destroyBuffer(mesh.indexBuffer);
+
+  retire(vkctx.meshes, handle, [](Mesh&) {});
+}
+
+// runs once every frame submitted so far has finished
+void deferDestroy(std::function<void()> destroy) {
+  pendingDestroys.emplace_back(vkctx.frameNumber, std::move(destroy));
+}
+
+// called once the frame's fence has signalled, a frame's fence has signalled
+// once it's framesInFlight frames old
+void retireResources() {
+  while (!pendingDestroys.empty() &&
+         pendingDestroys.front().first + vkctx.framesInFlight <=
+             vkctx.frameNumber) {
+    auto destroy = std::move(pendingDestroys.front().second);
+    pendingDestroys.pop_front();
+    destroy();
+  }
+}
+
+template <typename T>
+static void destroyLeaks(HandlePool<T>& pool, const char* kind,
+                         void (*destroy)(Handle<T>)) {
+  if (pool.size() == 0)
+    return;
+
+  std::cerr << "leaked " << pool.size() << " " << kind << std::endl;
+  for (auto handle : pool.handles())
+    destroy(handle);
+}
+
+// the device has to be idle, whatever is still in a pool was never destroyed
+// so it's reported and destroyed here
+void cleanupResources() {
+  // meshes go first, they destroy their buffers
+  destroyLeaks(vkctx.meshes, "meshes", destroyMesh);
+  destroyLeaks(vkctx.buffers, "buffers", destroyBuffer);
+  destroyLeaks(vkctx.images, "images", destroyImage);
+  destroyLeaks(vkctx.samplers, "samplers", destroySampler);
+  destroyLeaks(vkctx.pipelines, "pipelines", destroyPipeline);
+
+  while (!pendingDestroys.empty()) {
+    auto destroy = std::move(pendingDestroys.front().second);
+    pendingDestroys.pop_front();
+    destroy();
+  }
+}
@@ -2,12 +2,17 @@
 #include <common.hpp>
 
 std::vector<const char*> getRequiredExtensions() {
-  uint32_t extensionsCount;
+  std::vector<const char*> extensions;
 
-  SDL_Vulkan_GetInstanceExtensions(vkctx.win, &extensionsCount, nullptr);
-  std::vector<const char*> extensions(extensionsCount);
-  SDL_Vulkan_GetInstanceExtensions(vkctx.win, &extensionsCount,
-                                   extensions.data());
+  // without a window we don't need any surface extensions
+  if (!vkctx.headless) {
+    uint32_t extensionsCount;
+
+    SDL_Vulkan_GetInstanceExtensions(vkctx.win, &extensionsCount, nullptr);
+    extensions.resize(extensionsCount);
+    SDL_Vulkan_GetInstanceExtensions(vkctx.win, &extensionsCount,
+                                     extensions.data());
+  }
 
 #ifdef USE_VALIDATION_LAYERS
   extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
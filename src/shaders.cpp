@@ -0,0 +1,61 @@
+#include <shaders.hpp>
+
+// the .inc files are spir-v words written by glslc -mfmt=num, see
+// CMakeLists.txt
+static constexpr uint32_t TRIANGLE_VERT[] = {
+#include <triangle.vert.inc>
+};
+static constexpr uint32_t TRIANGLE_FRAG[] = {
+#include <triangle.frag.inc>
+};
+static constexpr uint32_t BINDLESS_FRAG[] = {
+#include <bindless.frag.inc>
+};
+static constexpr uint32_t CULL_COMP[] = {
+#include <cull.comp.inc>
+};
+static constexpr uint32_t GPU_VERT[] = {
+#include <gpu.vert.inc>
+};
+static constexpr uint32_t GPU_FRAG[] = {
+#include <gpu.frag.inc>
+};
+static constexpr uint32_t INSTANCED_VERT[] = {
+#include <instanced.vert.inc>
+};
+static constexpr uint32_t INSTANCED_FRAG[] = {
+#include <instanced.frag.inc>
+};
+static constexpr uint32_t INSTANCED_BINDLESS_FRAG[] = {
+#include <instanced_bindless.frag.inc>
+};
+
+template <size_t N>
+static constexpr ShaderCode embedded(const uint32_t (&code)[N]) {
+  return {code, sizeof(code)};
+}
+
+ShaderCode shaderCode(Shader shader) {
+  switch (shader) {
+  case Shader::TriangleVert:
+    return embedded(TRIANGLE_VERT);
+  case Shader::TriangleFrag:
+    return embedded(TRIANGLE_FRAG);
+  case Shader::BindlessFrag:
+    return embedded(BINDLESS_FRAG);
+  case Shader::CullComp:
+    return embedded(CULL_COMP);
+  case Shader::GpuVert:
+    return embedded(GPU_VERT);
+  case Shader::GpuFrag:
+    return embedded(GPU_FRAG);
+  case Shader::InstancedVert:
+    return embedded(INSTANCED_VERT);
+  case Shader::InstancedFrag:
+    return embedded(INSTANCED_FRAG);
+  case Shader::InstancedBindlessFrag:
+    return embedded(INSTANCED_BINDLESS_FRAG);
+  }
+
+  throw std::invalid_argument("unknown shader");
+}
@@ -0,0 +1,138 @@
+#include <profiler.hpp>
+#include <startup.hpp>
+#include <vulkan.hpp>
+
+using StartupClock = std::chrono::steady_clock;
+
+// set during static initialization, which is close enough to launch
+static const StartupClock::time_point launchTime = StartupClock::now();
+
+static std::mutex stepsMutex;
+static std::vector<StartupStep> steps;
+static double firstFrame = 0.0;
+
+// files read by jobs, each with its own counter so loading one only waits
+// for that one, the map itself is only touched by the main thread
+struct PreloadedFile {
+  JobCounter counter;
+  std::vector<char> data;
+  bool found = false;
+};
+
+static std::map<std::string, std::unique_ptr<PreloadedFile>> preloads;
+
+static double sinceLaunch(StartupClock::time_point time) {
+  return std::chrono::duration<double, std::milli>(time - launchTime).count();
+}
+
+static void recordStep(const std::string& name, StartupClock::time_point start,
+                       bool job) {
+  double begin = sinceLaunch(start);
+  double end = sinceLaunch(StartupClock::now());
+
+  std::lock_guard<std::mutex> lock(stepsMutex);
+  steps.push_back({name, begin, end - begin, job});
+}
+
+// runs the step on the calling thread once the jobs it depends on have
+// finished and records how long it took, not counting the wait
+void startupStep(const char* name, const std::function<void()>& step,
+                 std::initializer_list<JobCounter*> after) {
+  for (JobCounter* dependency : after)
+    waitForJobs(*dependency);
+
+  PROFILE_ZONE(name);
+  auto start = StartupClock::now();
+  step();
+  recordStep(name, start, false);
+}
+
+// runs a step that doesn't touch vulkan on a job, so it overlaps with the
+// steps on the main thread, the ones that need its results wait for done
+void startupJob(const char* name, Job step, JobCounter& done) {
+  runJob(
+      [name, step] {
+        PROFILE_ZONE(name);
+        auto start = StartupClock::now();
+        step();
+        recordStep(name, start, true);
+      },
+      &done);
+}
+
+// starts reading the file on a job, a missing file is only an error once
+// something loads it
+void preloadFile(const std::string& path) {
+  if (preloads.count(path))
+    return;
+
+  auto& file = preloads[path];
+  file = std::make_unique<PreloadedFile>();
+  PreloadedFile* target = file.get();
+
+  runJob(
+      [path, target] {
+        PROFILE_ZONE("preload file");
+        auto start = StartupClock::now();
+        try {
+          target->data = readFile(path);
+          target->found = true;
+        } catch (const std::runtime_error&) {
+        }
+        recordStep("read " + path, start, true);
+      },
+      &target->counter);
+}
+
+// waits for the file if it's being preloaded and reads it right away if it
+// isn't, throws like readFile if it doesn't exist
+std::vector<char> loadFile(const std::string& path) {
+  auto it = preloads.find(path);
+  if (it == preloads.end())
+    return readFile(path);
+
+  waitForJobs(it->second->counter);
+  bool found = it->second->found;
+  std::vector<char> data = std::move(it->second->data);
+  preloads.erase(it);
+
+  return found ? data : readFile(path);
+}
+
+// called once the first frame has been submitted, prints every step
+void finishStartup() {
+  firstFrame = sinceLaunch(StartupClock::now());
+
+  // whatever nobody loaded, like shaders for paths the device can't use
+  for (auto& preload : preloads)
+    waitForJobs(preload.second->counter);
+  preloads.clear();
+
+  std::ostringstream report;
+  report << std::fixed << std::setprecision(1);
+  report << "first frame after " << firstFrame << " ms" << std::endl;
+  for (const auto& step : startupSteps()) {
+    report << std::setw(8) << step.start << " +" << std::setw(7)
+           << step.duration << " ms " << step.name
+           << (step.job ? " (job)" : "") << std::endl;
+  }
+  std::cerr << report.str();
+}
+
+// 0 until the first frame
+double firstFrameTime() { return firstFrame; }
+
+// in the order they started
+std::vector<StartupStep> startupSteps() {
+  std::vector<StartupStep> sorted;
+  {
+    std::lock_guard<std::mutex> lock(stepsMutex);
+    sorted = steps;
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const StartupStep& a, const StartupStep& b) {
+                     return a.start < b.start;
+                   });
+
+  return sorted;
+}
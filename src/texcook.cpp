@@ -0,0 +1,165 @@
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
+#include <stb_image.h>
+#include <texfile.hpp>
+
+struct Level {
+  uint32_t width;
+  uint32_t height;
+  std::vector<uint8_t> pixels;
+};
+
+// 2x2 box filter, odd edges reuse the last row or column
+static Level downsample(const Level& src) {
+  Level dst;
+  dst.width = std::max(src.width / 2, 1u);
+  dst.height = std::max(src.height / 2, 1u);
+  dst.pixels.resize(dst.width * dst.height * 4);
+
+  for (uint32_t y = 0; y < dst.height; y++) {
+    uint32_t y0 = std::min(y * 2, src.height - 1);
+    uint32_t y1 = std::min(y * 2 + 1, src.height - 1);
+
+    for (uint32_t x = 0; x < dst.width; x++) {
+      uint32_t x0 = std::min(x * 2, src.width - 1);
+      uint32_t x1 = std::min(x * 2 + 1, src.width - 1);
+
+      for (uint32_t c = 0; c < 4; c++) {
+        uint32_t sum = src.pixels[(y0 * src.width + x0) * 4 + c] +
+                       src.pixels[(y0 * src.width + x1) * 4 + c] +
+                       src.pixels[(y1 * src.width + x0) * 4 + c] +
+                       src.pixels[(y1 * src.width + x1) * 4 + c];
+        dst.pixels[(y * dst.width + x) * 4 + c] =
+            static_cast<uint8_t>((sum + 2) / 4);
+      }
+    }
+  }
+
+  return dst;
+}
+
+// blocks hanging off the edge repeat the last pixel
+static std::vector<uint8_t> compress(const Level& level,
+                                     TextureFileFormat format) {
+  uint32_t blocksWide = (level.width + 3) / 4;
+  uint32_t blocksHigh = (level.height + 3) / 4;
+  uint32_t blockSize = textureBlockSize(format);
+
+  std::vector<uint8_t> blocks(blocksWide * blocksHigh * blockSize);
+  uint8_t texels[16 * 4];
+
+  for (uint32_t by = 0; by < blocksHigh; by++) {
+    for (uint32_t bx = 0; bx < blocksWide; bx++) {
+      for (uint32_t y = 0; y < 4; y++) {
+        uint32_t py = std::min(by * 4 + y, level.height - 1);
+        for (uint32_t x = 0; x < 4; x++) {
+          uint32_t px = std::min(bx * 4 + x, level.width - 1);
+          std::memcpy(&texels[(y * 4 + x) * 4],
+                      &level.pixels[(py * level.width + px) * 4], 4);
+        }
+      }
+
+      stb_compress_dxt_block(
+          &blocks[(by * blocksWide + bx) * blockSize], texels,
+          format == TextureFileFormat::BC3 ? 1 : 0, STB_DXT_HIGHQUAL);
+    }
+  }
+
+  return blocks;
+}
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// converts an image into a cooked texture with a full mip chain,
+// usage: texcook <input> <output> [bc1|bc3]
+// without a format bc3 is picked if the image has any transparency
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " <input> <output> [bc1|bc3]"
+              << std::endl;
+    return 1;
+  }
+
+  int width, height, channels;
+  stbi_uc* pixels =
+      stbi_load(argv[1], &width, &height, &channels, STBI_rgb_alpha);
+  if (!pixels) {
+    std::cerr << "failed to load " << argv[1] << std::endl;
+    return 1;
+  }
+
+  std::vector<Level> levels(1);
+  levels[0].width = static_cast<uint32_t>(width);
+  levels[0].height = static_cast<uint32_t>(height);
+  levels[0].pixels.assign(pixels, pixels + width * height * 4);
+  stbi_image_free(pixels);
+
+  TextureFileFormat format = TextureFileFormat::BC1;
+  if (argc > 3) {
+    std::string name = argv[3];
+    if (name == "bc3") {
+      format = TextureFileFormat::BC3;
+    } else if (name != "bc1") {
+      std::cerr << "unknown format " << name << std::endl;
+      return 1;
+    }
+  } else {
+    for (size_t i = 3; i < levels[0].pixels.size(); i += 4) {
+      if (levels[0].pixels[i] != 255) {
+        format = TextureFileFormat::BC3;
+        break;
+      }
+    }
+  }
+
+  while (levels.back().width > 1 || levels.back().height > 1)
+    levels.push_back(downsample(levels.back()));
+
+  TextureFileHeader header;
+  header.magic = TextureFileHeader::MAGIC;
+  header.version = TextureFileHeader::VERSION;
+  header.format = format;
+  header.width = levels[0].width;
+  header.height = levels[0].height;
+  header.mipLevels = static_cast<uint32_t>(levels.size());
+
+  std::vector<std::vector<uint8_t>> data;
+  std::vector<TextureFileLevel> entries;
+  uint64_t offset = alignUp(sizeof(TextureFileHeader) +
+                                levels.size() * sizeof(TextureFileLevel),
+                            16);
+
+  for (const auto& level : levels) {
+    data.push_back(compress(level, format));
+    entries.push_back({offset, data.back().size()});
+    offset = alignUp(offset + data.back().size(), 16);
+  }
+
+  std::ofstream file(argv[2], std::ios::binary);
+  if (!file) {
+    std::cerr << "failed to open " << argv[2] << std::endl;
+    return 1;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(entries.data()),
+             entries.size() * sizeof(TextureFileLevel));
+
+  for (size_t i = 0; i < data.size(); i++) {
+    file.seekp(entries[i].offset);
+    file.write(reinterpret_cast<const char*>(data[i].data()), data[i].size());
+  }
+
+  if (!file) {
+    std::cerr << "failed to write " << argv[2] << std::endl;
+    return 1;
+  }
+
+  std::cout << argv[2] << ": " << header.width << "x" << header.height << ", "
+            << header.mipLevels << " levels, "
+            << (format == TextureFileFormat::BC1 ? "bc1" : "bc3") << ", "
+            << offset << " bytes" << std::endl;
+}
@@ -0,0 +1,247 @@
+#include <profiler.hpp>
+#include <resources.hpp>
+#include <textures.hpp>
+#include <upload.hpp>
+
+// what a decode job hands back to the main thread, either a mapped cooked
+// texture or decoded pixels
+struct LoadedTexture {
+  ImageHandle image;
+  CookedTexture cooked;
+  DecodedImage decoded;
+  std::string error;
+};
+
+// only touched by the main thread
+static std::deque<std::pair<ImageHandle, std::string>> pendingLoads;
+static std::vector<ImageHandle> uploadingTextures;
+static uint32_t loadsInFlight = 0;
+
+// filled by decode jobs, never holds more than STREAM_QUEUE_SIZE entries
+// since that many loads are started at most
+static std::mutex loadedMutex;
+static std::deque<LoadedTexture> loadedTextures;
+static JobCounter decodeJobs;
+
+static void freeLoadedTexture(LoadedTexture& loaded) {
+  unmapCookedTexture(loaded.cooked);
+  if (loaded.decoded.pixels)
+    stbi_image_free(loaded.decoded.pixels);
+  loaded.decoded.pixels = nullptr;
+}
+
+// prefers the cooked version of the png if there is one and the device can
+// sample it
+static void decodeTexture(ImageHandle image, const std::string& path) {
+  PROFILE_ZONE("decode texture");
+  LoadedTexture loaded;
+  loaded.image = image;
+
+  try {
+    std::string cookedPath = path.substr(0, path.rfind('.')) + ".ctex";
+    loaded.cooked = mapCookedTexture(cookedPath.c_str());
+
+    if (loaded.cooked.header &&
+        !canSampleFormat(cookedTextureFormat(*loaded.cooked.header))) {
+      std::cerr << "can't sample " << cookedPath << ", using the png"
+                << std::endl;
+      unmapCookedTexture(loaded.cooked);
+    }
+
+    if (!loaded.cooked.header)
+      loaded.decoded = decodeImage(path.c_str());
+  } catch (const std::exception& e) {
+    freeLoadedTexture(loaded);
+    loaded.error = path + ": " + e.what();
+  }
+
+  std::lock_guard<std::mutex> lock(loadedMutex);
+  loadedTextures.push_back(std::move(loaded));
+}
+
+static void startLoads() {
+  while (loadsInFlight < vkctx.STREAM_QUEUE_SIZE && !pendingLoads.empty()) {
+    ImageHandle image = pendingLoads.front().first;
+    std::string path = pendingLoads.front().second;
+    pendingLoads.pop_front();
+    loadsInFlight++;
+
+    runBackgroundJob([image, path] { decodeTexture(image, path); },
+                     &decodeJobs);
+  }
+}
+
+void initTextures() {
+  auto limits = vkctx.physicalDevice.getProperties().limits;
+
+  // trilinear across whatever mip chain the bound texture has
+  vk::SamplerCreateInfo info(
+      {}, vk::Filter::eLinear, vk::Filter::eLinear,
+      vk::SamplerMipmapMode::eLinear, vk::SamplerAddressMode::eRepeat,
+      vk::SamplerAddressMode::eRepeat, vk::SamplerAddressMode::eRepeat, 0.0f,
+      VK_TRUE, std::min(16.0f, limits.maxSamplerAnisotropy), VK_FALSE,
+      vk::CompareOp::eAlways, 0.0f, VK_LOD_CLAMP_NONE,
+      vk::BorderColor::eIntOpaqueBlack, VK_FALSE);
+
+  vkctx.textureSampler = addSampler(info);
+
+  // a single grey texel, shown until a texture has finished uploading
+  stbi_uc grey[4] = {128, 128, 128, 255};
+  DecodedImage placeholder;
+  placeholder.pixels = grey;
+  placeholder.width = 1;
+  placeholder.height = 1;
+
+  vkctx.placeholderTexture = createTexture(placeholder);
+  vkctx.placeholderTexture.ready = true;
+}
+
+void cleanupTextures() {
+  // the jobs might still be decoding
+  waitForJobs(decodeJobs);
+
+  for (auto& loaded : loadedTextures)
+    freeLoadedTexture(loaded);
+  loadedTextures.clear();
+  pendingLoads.clear();
+  uploadingTextures.clear();
+  loadsInFlight = 0;
+
+  destroyTexture(vkctx.placeholderTexture);
+  destroySampler(vkctx.textureSampler);
+}
+
+// returns right away, the texture shows the placeholder until it's loaded,
+// the physical device has to be picked already, destroy it with destroyImage
+ImageHandle loadTexture(const std::string& path) {
+  ImageHandle image = addImage(Texture());
+
+  pendingLoads.emplace_back(image, path);
+  startLoads();
+
+  return image;
+}
+
+// called once per frame, uploads what the jobs have decoded up to the
+// budget, marks textures whose uploads have finished as ready and keeps the
+// decode queue full
+void updateTextures() {
+  PROFILE_ZONE("stream textures");
+  for (size_t i = 0; i < uploadingTextures.size();) {
+    ImageHandle image = uploadingTextures[i];
+    Texture* texture = vkctx.images.get(image);
+
+    if (texture && !uploadsComplete(texture->uploadId)) {
+      i++;
+      continue;
+    }
+
+    // textures destroyed while uploading are just dropped
+    if (texture) {
+      texture->ready = true;
+      if (vkctx.bindless && image.index + 1 < vkctx.bindlessCapacity)
+        writeTextureSlot(image.index + 1, texture->view);
+    }
+    uploadingTextures[i] = uploadingTextures.back();
+    uploadingTextures.pop_back();
+  }
+
+  std::vector<ImageHandle> uploaded;
+  vk::DeviceSize uploadedBytes = 0;
+
+  while (uploadedBytes < vkctx.STREAM_UPLOAD_BUDGET) {
+    LoadedTexture loaded;
+    {
+      std::lock_guard<std::mutex> lock(loadedMutex);
+      if (loadedTextures.empty())
+        break;
+      loaded = std::move(loadedTextures.front());
+      loadedTextures.pop_front();
+    }
+    loadsInFlight--;
+
+    // a broken texture keeps showing the placeholder
+    if (!loaded.error.empty()) {
+      std::cerr << "failed to load texture " << loaded.error << std::endl;
+      continue;
+    }
+
+    // or was destroyed while it was decoding
+    Texture* texture = vkctx.images.get(loaded.image);
+    if (!texture) {
+      freeLoadedTexture(loaded);
+      continue;
+    }
+
+    if (loaded.cooked.header) {
+      *texture = createCookedTexture(loaded.cooked);
+      uploadedBytes += loaded.cooked.size;
+    } else {
+      *texture = createTexture(loaded.decoded);
+      uploadedBytes += loaded.decoded.width * loaded.decoded.height * 4;
+    }
+
+    freeLoadedTexture(loaded);
+    uploaded.push_back(loaded.image);
+  }
+
+  if (!uploaded.empty()) {
+    // the graphics queue orders rendering after the upload, but the
+    // descriptors are only switched over once it has actually finished
+    uint64_t id = submitUploads();
+    for (ImageHandle image : uploaded) {
+      getImage(image).uploadId = id;
+      uploadingTextures.push_back(image);
+    }
+  }
+
+  startLoads();
+}
+
+// destroyed textures show the placeholder too
+const Texture& getTexture(ImageHandle image) {
+  const Texture* texture = vkctx.images.get(image);
+  return texture && texture->ready ? *texture : vkctx.placeholderTexture;
+}
+
+// a texture's slot is its handle's index + 1, textures that aren't ready or
+// don't fit in the array use the placeholder
+uint32_t getTextureSlot(ImageHandle image) {
+  const Texture* texture = vkctx.images.get(image);
+  if (!vkctx.bindless || !texture || !texture->ready ||
+      image.index + 1 >= vkctx.bindlessCapacity)
+    return 0;
+
+  return image.index + 1;
+}
+
+// slots are partially bound and update after bind, so this is fine while
+// frames are in flight as long as none of them uses the slot
+void writeTextureSlot(uint32_t slot, vk::ImageView view) {
+  vk::DescriptorImageInfo imageInfo(getSampler(vkctx.textureSampler), view,
+                                    vk::ImageLayout::eShaderReadOnlyOptimal);
+  vk::WriteDescriptorSet write(vkctx.textureSet, 0, slot, 1,
+                               vk::DescriptorType::eCombinedImageSampler,
+                               &imageInfo, nullptr, nullptr);
+  vkctx.device.updateDescriptorSets(1, &write, 0, nullptr);
+}
+
+// the frame's fence has to have signalled, its descriptor set can't be in
+// use, not needed with bindless textures
+void bindTextures(uint32_t frame) {
+  if (vkctx.bindless)
+    return;
+
+  vk::ImageView view = getTexture(vkctx.sceneTexture).view;
+  if (vkctx.boundTextures[frame] == view)
+    return;
+
+  vk::DescriptorImageInfo imageInfo(getSampler(vkctx.textureSampler), view,
+                                    vk::ImageLayout::eShaderReadOnlyOptimal);
+  vk::WriteDescriptorSet write(vkctx.descriptorSets[frame], 1, 0, 1,
+                               vk::DescriptorType::eCombinedImageSampler,
+                               &imageInfo, nullptr, nullptr);
+  vkctx.device.updateDescriptorSets(1, &write, 0, nullptr);
+
+  vkctx.boundTextures[frame] = view;
+}
@@ -0,0 +1,436 @@
+#include <image.hpp>
+#include <profiler.hpp>
+#include <upload.hpp>
+
+static inline bool dedicatedTransfer() {
+  return vkctx.transferFamily != vkctx.graphicsFamily;
+}
+
+// the part of a batch that runs on the graphics queue
+static inline vk::CommandBuffer graphicsCommands(const UploadBatch& batch) {
+  return dedicatedTransfer() ? batch.acquireCommands : batch.commands;
+}
+
+// where an upload is copied from, data points at offset in the mapped buffer
+struct StagingSpace {
+  vk::Buffer buffer;
+  vk::DeviceSize offset;
+  uint8_t* data;
+};
+
+static inline vk::DeviceSize alignUp(vk::DeviceSize value,
+                                     vk::DeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+void initUploads() {
+  vk::BufferCreateInfo bufferInfo({}, vkctx.STAGING_SIZE,
+                                  vk::BufferUsageFlagBits::eTransferSrc);
+
+  VmaAllocationCreateInfo allocInfo = {};
+  allocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+  allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+  VmaAllocationInfo info;
+  vmaCreateBuffer(vkctx.allocator,
+                  reinterpret_cast<VkBufferCreateInfo*>(&bufferInfo),
+                  &allocInfo, reinterpret_cast<VkBuffer*>(&vkctx.stagingBuffer),
+                  &vkctx.stagingAllocation, &info);
+  vkctx.stagingData = static_cast<uint8_t*>(info.pMappedData);
+
+  // buffer to image copies need offsets that are a multiple of the texel
+  // size, 16 covers every format we upload
+  auto limits = vkctx.physicalDevice.getProperties().limits;
+  vkctx.stagingAlignment = std::max<vk::DeviceSize>(
+      16, limits.optimalBufferCopyOffsetAlignment);
+
+  vk::CommandPoolCreateInfo poolInfo(
+      vk::CommandPoolCreateFlagBits::eTransient |
+          vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+      vkctx.transferFamily);
+  vkctx.uploadPool = vkctx.device.createCommandPool(poolInfo);
+
+  if (dedicatedTransfer()) {
+    poolInfo.queueFamilyIndex = vkctx.graphicsFamily;
+    vkctx.acquirePool = vkctx.device.createCommandPool(poolInfo);
+  }
+}
+
+static UploadBatch createUploadBatch() {
+  UploadBatch batch;
+
+  vk::CommandBufferAllocateInfo allocInfo(vkctx.uploadPool,
+                                          vk::CommandBufferLevel::ePrimary, 1);
+  batch.commands = vkctx.device.allocateCommandBuffers(allocInfo)[0];
+
+  if (dedicatedTransfer()) {
+    allocInfo.commandPool = vkctx.acquirePool;
+    batch.acquireCommands = vkctx.device.allocateCommandBuffers(allocInfo)[0];
+    batch.transferSemaphore =
+        vkctx.device.createSemaphore(vk::SemaphoreCreateInfo());
+  }
+
+  batch.fence = vkctx.device.createFence(vk::FenceCreateInfo());
+
+  return batch;
+}
+
+// hands finished batches back to the free list and releases their part of the
+// staging ring, batches finish in the order they were submitted
+static void retireUploads() {
+  while (!vkctx.uploadsInFlight.empty()) {
+    UploadBatch batch = vkctx.uploadsInFlight.front();
+
+    if (vkctx.device.getFenceStatus(batch.fence) != vk::Result::eSuccess)
+      break;
+
+    vkctx.device.resetFences(batch.fence);
+    vkctx.stagingUsed -= batch.stagingBytes;
+    vkctx.completedUploadId = batch.id;
+
+    for (size_t i = 0; i < batch.dedicatedStaging.size(); i++)
+      vmaDestroyBuffer(vkctx.allocator, batch.dedicatedStaging[i],
+                       batch.dedicatedAllocations[i]);
+    batch.dedicatedStaging.clear();
+    batch.dedicatedAllocations.clear();
+
+    batch.stagingBytes = 0;
+    vkctx.freeUploads.push_back(batch);
+    vkctx.uploadsInFlight.pop_front();
+  }
+}
+
+static UploadBatch& currentUpload() {
+  if (!vkctx.upload.recording) {
+    retireUploads();
+
+    if (vkctx.freeUploads.empty()) {
+      vkctx.upload = createUploadBatch();
+    } else {
+      vkctx.upload = vkctx.freeUploads.back();
+      vkctx.freeUploads.pop_back();
+    }
+
+    vk::CommandBufferBeginInfo beginInfo(
+        vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+    vkctx.upload.commands.begin(beginInfo);
+    if (dedicatedTransfer())
+      vkctx.upload.acquireCommands.begin(beginInfo);
+
+    vkctx.upload.id = vkctx.nextUploadId++;
+    vkctx.upload.recording = true;
+
+    // with a dedicated transfer queue this only times the acquire and mip
+    // generation, transfer queues can't reset queries
+    vkctx.upload.profileZone =
+        beginGpuZone(graphicsCommands(vkctx.upload), "upload", vkctx.upload.id);
+  }
+
+  return vkctx.upload;
+}
+
+// the used part of the ring runs from the tail up to the head, possibly
+// wrapping around the end, consumed includes any padding we skip over
+static bool tryAllocateStaging(vk::DeviceSize size, vk::DeviceSize& offset,
+                               vk::DeviceSize& consumed) {
+  const vk::DeviceSize capacity = vkctx.STAGING_SIZE;
+
+  if (vkctx.stagingUsed == 0)
+    vkctx.stagingHead = 0;
+  if (vkctx.stagingUsed == capacity)
+    return false;
+
+  vk::DeviceSize head = vkctx.stagingHead;
+  vk::DeviceSize tail = (head + capacity - vkctx.stagingUsed) % capacity;
+  vk::DeviceSize aligned = alignUp(head, vkctx.stagingAlignment);
+
+  if (tail <= head) {
+    if (aligned + size <= capacity) {
+      offset = aligned;
+      consumed = aligned + size - head;
+    } else if (size <= tail) {
+      offset = 0;
+      consumed = capacity - head + size;
+    } else {
+      return false;
+    }
+  } else {
+    if (aligned + size > tail)
+      return false;
+    offset = aligned;
+    consumed = aligned + size - head;
+  }
+
+  vkctx.stagingHead = (offset + size) % capacity;
+  vkctx.stagingUsed += consumed;
+
+  return true;
+}
+
+// a buffer only for this upload, the ring would have to be bigger than it
+// to hold it at all
+static StagingSpace allocateDedicatedStaging(vk::DeviceSize size) {
+  vk::BufferCreateInfo bufferInfo({}, size,
+                                  vk::BufferUsageFlagBits::eTransferSrc);
+
+  VmaAllocationCreateInfo allocInfo = {};
+  allocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+  allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+  vk::Buffer buffer;
+  VmaAllocation allocation;
+  VmaAllocationInfo info;
+  if (vmaCreateBuffer(vkctx.allocator,
+                      reinterpret_cast<VkBufferCreateInfo*>(&bufferInfo),
+                      &allocInfo, reinterpret_cast<VkBuffer*>(&buffer),
+                      &allocation, &info) != VK_SUCCESS)
+    throw std::runtime_error("failed to allocate a staging buffer");
+
+  UploadBatch& batch = currentUpload();
+  batch.dedicatedStaging.push_back(buffer);
+  batch.dedicatedAllocations.push_back(allocation);
+
+  return {buffer, 0, static_cast<uint8_t*>(info.pMappedData)};
+}
+
+static StagingSpace allocateStaging(vk::DeviceSize size) {
+  if (size > vkctx.STAGING_SIZE)
+    return allocateDedicatedStaging(size);
+
+  vk::DeviceSize offset, consumed;
+
+  while (!tryAllocateStaging(size, offset, consumed)) {
+    // the ring is full of pending uploads, send ours off and wait for the
+    // oldest batch to free its space
+    submitUploads();
+    waitForUploads(vkctx.uploadsInFlight.front().id);
+  }
+
+  currentUpload().stagingBytes += consumed;
+
+  return {vkctx.stagingBuffer, offset, vkctx.stagingData + offset};
+}
+
+void uploadBuffer(vk::Buffer buffer, const void* data, vk::DeviceSize size,
+                  vk::AccessFlags dstAccess, vk::PipelineStageFlags dstStage) {
+  StagingSpace staging = allocateStaging(size);
+  SDL_memcpy(staging.data, data, static_cast<size_t>(size));
+
+  UploadBatch& batch = currentUpload();
+
+  vk::BufferCopy copy(staging.offset, 0, size);
+  batch.commands.copyBuffer(staging.buffer, buffer, copy);
+
+  vk::BufferMemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite,
+                                  dstAccess, VK_QUEUE_FAMILY_IGNORED,
+                                  VK_QUEUE_FAMILY_IGNORED, buffer, 0,
+                                  VK_WHOLE_SIZE);
+
+  if (dedicatedTransfer()) {
+    // release on the transfer queue and acquire on the graphics queue
+    barrier.srcQueueFamilyIndex = vkctx.transferFamily;
+    barrier.dstQueueFamilyIndex = vkctx.graphicsFamily;
+    barrier.dstAccessMask = static_cast<vk::AccessFlags>(0);
+    batch.commands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                   vk::PipelineStageFlagBits::eBottomOfPipe,
+                                   static_cast<vk::DependencyFlags>(0), 0,
+                                   nullptr, 1, &barrier, 0, nullptr);
+
+    barrier.srcAccessMask = static_cast<vk::AccessFlags>(0);
+    barrier.dstAccessMask = dstAccess;
+    batch.acquireCommands.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTopOfPipe, dstStage,
+        static_cast<vk::DependencyFlags>(0), 0, nullptr, 1, &barrier, 0,
+        nullptr);
+  } else {
+    batch.commands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                   dstStage,
+                                   static_cast<vk::DependencyFlags>(0), 0,
+                                   nullptr, 1, &barrier, 0, nullptr);
+  }
+}
+
+// moves every level of an image that was filled with transfers into
+// eShaderReadOnlyOptimal on the graphics queue, blitting the mip chain down
+// from level 0 first if generateMips is set
+static void finishImageUpload(UploadBatch& batch, vk::Image image,
+                              vk::Format format, uint32_t width,
+                              uint32_t height, uint32_t mipLevels,
+                              bool generateMips) {
+  if (dedicatedTransfer()) {
+    // blits need a graphics queue, so the chain is generated after the
+    // acquire, otherwise the layout change happens as part of the ownership
+    // transfer
+    vk::ImageMemoryBarrier barrier(
+        vk::AccessFlagBits::eTransferWrite, static_cast<vk::AccessFlags>(0),
+        vk::ImageLayout::eTransferDstOptimal,
+        generateMips ? vk::ImageLayout::eTransferDstOptimal
+                     : vk::ImageLayout::eShaderReadOnlyOptimal,
+        vkctx.transferFamily, vkctx.graphicsFamily, image,
+        vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0,
+                                  mipLevels, 0, 1));
+    batch.commands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                   vk::PipelineStageFlagBits::eBottomOfPipe,
+                                   static_cast<vk::DependencyFlags>(0), 0,
+                                   nullptr, 0, nullptr, 1, &barrier);
+
+    barrier.srcAccessMask = static_cast<vk::AccessFlags>(0);
+    if (generateMips) {
+      barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead |
+                              vk::AccessFlagBits::eTransferWrite;
+      batch.acquireCommands.pipelineBarrier(
+          vk::PipelineStageFlagBits::eTopOfPipe,
+          vk::PipelineStageFlagBits::eTransfer,
+          static_cast<vk::DependencyFlags>(0), 0, nullptr, 0, nullptr, 1,
+          &barrier);
+
+      generateMipmaps(batch.acquireCommands, image, format, width, height,
+                      mipLevels);
+    } else {
+      barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+      batch.acquireCommands.pipelineBarrier(
+          vk::PipelineStageFlagBits::eTopOfPipe,
+          vk::PipelineStageFlagBits::eFragmentShader,
+          static_cast<vk::DependencyFlags>(0), 0, nullptr, 0, nullptr, 1,
+          &barrier);
+    }
+  } else if (generateMips) {
+    generateMipmaps(batch.commands, image, format, width, height, mipLevels);
+  } else {
+    transitiionImageLayout(batch.commands, image, format,
+                           vk::ImageLayout::eTransferDstOptimal,
+                           vk::ImageLayout::eShaderReadOnlyOptimal, 0,
+                           mipLevels);
+  }
+}
+
+// uploads level 0 and generates the rest of the mip chain from it
+void uploadImage(vk::Image image, vk::Format format, const void* data,
+                 vk::DeviceSize size, uint32_t width, uint32_t height,
+                 uint32_t mipLevels) {
+  StagingSpace staging = allocateStaging(size);
+  SDL_memcpy(staging.data, data, static_cast<size_t>(size));
+
+  UploadBatch& batch = currentUpload();
+
+  // every level starts out as a transfer destination, only level 0 comes
+  // from staging and the rest are blitted from it
+  transitiionImageLayout(batch.commands, image, format,
+                         vk::ImageLayout::eUndefined,
+                         vk::ImageLayout::eTransferDstOptimal, 0, mipLevels);
+
+  vk::BufferImageCopy region(
+      staging.offset, 0, 0,
+      vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
+      {0, 0, 0}, {width, height, 1});
+
+  batch.commands.copyBufferToImage(staging.buffer, image,
+                                   vk::ImageLayout::eTransferDstOptimal, 1,
+                                   &region);
+
+  finishImageUpload(batch, image, format, width, height, mipLevels,
+                    mipLevels > 1);
+}
+
+// uploads a whole precomputed mip chain, levelOffsets are relative to data
+// and have to keep the format's block alignment
+void uploadImageLevels(vk::Image image, vk::Format format, const void* data,
+                       vk::DeviceSize size, uint32_t width, uint32_t height,
+                       const std::vector<vk::DeviceSize>& levelOffsets) {
+  StagingSpace staging = allocateStaging(size);
+  SDL_memcpy(staging.data, data, static_cast<size_t>(size));
+
+  UploadBatch& batch = currentUpload();
+  uint32_t mipLevels = static_cast<uint32_t>(levelOffsets.size());
+
+  transitiionImageLayout(batch.commands, image, format,
+                         vk::ImageLayout::eUndefined,
+                         vk::ImageLayout::eTransferDstOptimal, 0, mipLevels);
+
+  std::vector<vk::BufferImageCopy> regions;
+  regions.reserve(mipLevels);
+  for (uint32_t level = 0; level < mipLevels; level++) {
+    regions.emplace_back(
+        staging.offset + levelOffsets[level], 0, 0,
+        vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level, 0,
+                                   1),
+        vk::Offset3D(0, 0, 0),
+        vk::Extent3D(std::max(width >> level, 1u),
+                     std::max(height >> level, 1u), 1));
+  }
+
+  batch.commands.copyBufferToImage(
+      staging.buffer, image, vk::ImageLayout::eTransferDstOptimal,
+      static_cast<uint32_t>(regions.size()), regions.data());
+
+  finishImageUpload(batch, image, format, width, height, mipLevels, false);
+}
+
+// submits everything recorded since the last call, the returned id can be
+// passed to uploadsComplete or waitForUploads
+uint64_t submitUploads() {
+  if (!vkctx.upload.recording)
+    return vkctx.nextUploadId - 1;
+
+  PROFILE_ZONE("submit uploads");
+  UploadBatch& batch = vkctx.upload;
+  endGpuZone(graphicsCommands(batch), batch.profileZone);
+  batch.commands.end();
+
+  if (dedicatedTransfer()) {
+    batch.acquireCommands.end();
+
+    vk::SubmitInfo transferInfo(0, nullptr, nullptr, 1, &batch.commands, 1,
+                                &batch.transferSemaphore);
+    vkctx.transferQueue.submit(transferInfo, nullptr);
+
+    vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+    vk::SubmitInfo acquireInfo(1, &batch.transferSemaphore, &waitStage, 1,
+                               &batch.acquireCommands, 0, nullptr);
+    vkctx.graphicsQueue.submit(acquireInfo, batch.fence);
+  } else {
+    vk::SubmitInfo info(0, nullptr, nullptr, 1, &batch.commands, 0, nullptr);
+    vkctx.graphicsQueue.submit(info, batch.fence);
+  }
+
+  batch.recording = false;
+  vkctx.uploadsInFlight.push_back(batch);
+
+  return batch.id;
+}
+
+bool uploadsComplete(uint64_t id) {
+  retireUploads();
+  return vkctx.completedUploadId >= id;
+}
+
+void waitForUploads(uint64_t id) {
+  if (vkctx.upload.recording && vkctx.upload.id <= id)
+    submitUploads();
+
+  for (const auto& batch : vkctx.uploadsInFlight) {
+    if (batch.id > id)
+      break;
+    vkctx.device.waitForFences(1, &batch.fence, VK_TRUE, UINT64_MAX);
+  }
+
+  retireUploads();
+}
+
+void cleanupUploads() {
+  waitForUploads(vkctx.nextUploadId - 1);
+
+  for (const auto& batch : vkctx.freeUploads) {
+    vkctx.device.destroyFence(batch.fence);
+    if (dedicatedTransfer())
+      vkctx.device.destroySemaphore(batch.transferSemaphore);
+  }
+  vkctx.freeUploads.clear();
+
+  vkctx.device.destroyCommandPool(vkctx.uploadPool);
+  if (dedicatedTransfer())
+    vkctx.device.destroyCommandPool(vkctx.acquirePool);
+
+  vmaDestroyBuffer(vkctx.allocator, vkctx.stagingBuffer,
+                   vkctx.stagingAllocation);
+}
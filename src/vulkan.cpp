@@ -1,4 +1,15 @@
 #define VMA_IMPLEMENTATION
+#include <cull.hpp>
+#include <jobs.hpp>
+#include <mesh.hpp>
+#include <pipelines.hpp>
+#include <profiler.hpp>
+#include <record.hpp>
+#include <rendergraph.hpp>
+#include <resources.hpp>
+#include <startup.hpp>
+#include <textures.hpp>
+#include <upload.hpp>
 #include <vulkan.hpp>
 
 #ifdef USE_VALIDATION_LAYERS
@@ -124,10 +135,20 @@ static QueueIndices getQueueIndices(vk::PhysicalDevice device) {
   for (uint32_t i = 0; i < queueFamiles.size(); i++) {
     if (queueFamiles[i].queueFlags & vk::QueueFlagBits::eGraphics) {
       indices.graphicsFamily = i;
+      // nothing is presented when headless, so just use the graphics queue
+      if (vkctx.headless)
+        indices.presentFamily = i;
     }
-    if (device.getSurfaceSupportKHR(i, vkctx.surface)) {
+    if (!vkctx.headless && device.getSurfaceSupportKHR(i, vkctx.surface)) {
       indices.presentFamily = i;
     }
+    // prefer a transfer only family, those map to the copy engines
+    if (!(queueFamiles[i].queueFlags & vk::QueueFlagBits::eGraphics) &&
+        (queueFamiles[i].queueFlags & vk::QueueFlagBits::eTransfer) &&
+        (!indices.transferFamily.has_value() ||
+         !(queueFamiles[i].queueFlags & vk::QueueFlagBits::eCompute))) {
+      indices.transferFamily = i;
+    }
   }
 
   return indices;
@@ -145,6 +166,67 @@ static bool checkDeviceExtensionSupport(vk::PhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
+static bool hasDeviceExtension(vk::PhysicalDevice device,
+                               const char* extensionName) {
+  auto availableExtensions = device.enumerateDeviceExtensionProperties();
+
+  for (const auto& extension : availableExtensions) {
+    if (std::string(extension.extensionName) == extensionName)
+      return true;
+  }
+
+  return false;
+}
+
+// bindless textures need an array of sampled images that can be indexed
+// dynamically, updated while bound and left partially empty
+static bool supportsBindless(vk::PhysicalDevice device) {
+  if (device.getProperties().apiVersion < VK_API_VERSION_1_1 ||
+      !hasDeviceExtension(device, VK_KHR_MAINTENANCE3_EXTENSION_NAME) ||
+      !hasDeviceExtension(device, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+    return false;
+
+  auto chain =
+      device.getFeatures2<vk::PhysicalDeviceFeatures2,
+                          vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+  const auto& features = chain.get<vk::PhysicalDeviceFeatures2>().features;
+  const auto& indexing =
+      chain.get<vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+
+  // instances pick their own texture, so the index can vary within a draw
+  return features.shaderSampledImageArrayDynamicIndexing &&
+         indexing.shaderSampledImageArrayNonUniformIndexing &&
+         indexing.runtimeDescriptorArray &&
+         indexing.descriptorBindingPartiallyBound &&
+         indexing.descriptorBindingSampledImageUpdateAfterBind;
+}
+
+// the gpu driven path draws everything with one indirect count call and
+// picks textures per object, so it builds on bindless textures
+static bool supportsGpuDriven(vk::PhysicalDevice device) {
+  if (!supportsBindless(device) ||
+      !hasDeviceExtension(device, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME))
+    return false;
+
+  auto features = device.getFeatures();
+
+  return features.multiDrawIndirect && features.drawIndirectFirstInstance;
+}
+
+// the extension's dependencies are core in 1.2, which the instance asks for
+static bool supportsDynamicRendering(vk::PhysicalDevice device) {
+  if (device.getProperties().apiVersion < VK_API_VERSION_1_2 ||
+      !hasDeviceExtension(device, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME))
+    return false;
+
+  auto chain =
+      device.getFeatures2<vk::PhysicalDeviceFeatures2,
+                          vk::PhysicalDeviceDynamicRenderingFeaturesKHR>();
+
+  return chain.get<vk::PhysicalDeviceDynamicRenderingFeaturesKHR>()
+      .dynamicRendering;
+}
+
 static inline SwapchainSupportDetails
 querySwapchainSupport(vk::PhysicalDevice device) {
   SwapchainSupportDetails details;
@@ -160,10 +242,13 @@ static inline bool checkDevice(vk::PhysicalDevice device) {
   auto indices = getQueueIndices(device);
   bool indicesSupported = indices.isComplete();
 
-  bool extensionsSupported = checkDeviceExtensionSupport(device);
-
   auto features = device.getFeatures();
 
+  if (vkctx.headless)
+    return indicesSupported && features.samplerAnisotropy;
+
+  bool extensionsSupported = checkDeviceExtensionSupport(device);
+
   auto swapchainSupport = querySwapchainSupport(device);
   bool swapchainSupported = !swapchainSupport.formats.empty() &&
                             !swapchainSupport.presentModes.empty();
@@ -200,6 +285,8 @@ static void createDevice() {
   std::vector<vk::DeviceQueueCreateInfo> queueInfos;
   std::set<uint32_t> uniqueQueues = {indices.graphicsFamily.value(),
                                      indices.presentFamily.value()};
+  if (indices.transferFamily.has_value())
+    uniqueQueues.insert(indices.transferFamily.value());
 
   for (uint32_t queueFamily : uniqueQueues) {
     queueInfos.push_back(
@@ -208,6 +295,79 @@ static void createDevice() {
 
   vk::PhysicalDeviceFeatures features;
   features.samplerAnisotropy = VK_TRUE;
+  // cooked textures are only used when the device can sample their format
+  features.textureCompressionBC =
+      vkctx.physicalDevice.getFeatures().textureCompressionBC;
+
+  // the swapchain extension isn't needed or required when headless
+  std::vector<const char*> extensions;
+  if (!vkctx.headless)
+    extensions = vkctx.deviceExtensions;
+
+  if (hasDeviceExtension(vkctx.physicalDevice,
+                         VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME)) {
+    extensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+    vkctx.pipelineFeedback = true;
+  }
+
+  vk::PhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures;
+  if (supportsBindless(vkctx.physicalDevice)) {
+    extensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+    extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+    features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+    indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+    indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+    indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+
+    using IndexingProperties =
+        vk::PhysicalDeviceDescriptorIndexingPropertiesEXT;
+    auto chain = vkctx.physicalDevice.getProperties2<
+        vk::PhysicalDeviceProperties2, IndexingProperties>();
+    const auto& limits =
+        chain.get<vk::PhysicalDeviceProperties2>().properties.limits;
+    const auto& indexing = chain.get<IndexingProperties>();
+
+    vkctx.bindlessCapacity = std::min(
+        {vkctx.MAX_BINDLESS_TEXTURES,
+         indexing.maxPerStageDescriptorUpdateAfterBindSampledImages,
+         indexing.maxPerStageDescriptorUpdateAfterBindSamplers,
+         indexing.maxDescriptorSetUpdateAfterBindSampledImages,
+         indexing.maxDescriptorSetUpdateAfterBindSamplers,
+         limits.maxPerStageResources});
+    vkctx.bindless = true;
+  }
+
+  if (vkctx.allowGpuDriven && supportsGpuDriven(vkctx.physicalDevice)) {
+    extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    features.multiDrawIndirect = VK_TRUE;
+    features.drawIndirectFirstInstance = VK_TRUE;
+    vkctx.gpuDriven = true;
+  }
+  // everything is drawn by the gpu driven path then
+  if (vkctx.gpuDriven)
+    vkctx.instanced = false;
+
+  // secondaries are executed while the query is active
+  if (vkctx.overdrawStats) {
+    auto supported = vkctx.physicalDevice.getFeatures();
+    if (supported.pipelineStatisticsQuery && supported.inheritedQueries) {
+      features.pipelineStatisticsQuery = VK_TRUE;
+      features.inheritedQueries = VK_TRUE;
+    } else {
+      std::cerr << "pipeline statistics aren't supported, disabling the "
+                   "overdraw counter"
+                << std::endl;
+      vkctx.overdrawStats = false;
+    }
+  }
+
+  vk::PhysicalDeviceDynamicRenderingFeaturesKHR renderingFeatures(VK_TRUE);
+  if (vkctx.allowDynamicRendering &&
+      supportsDynamicRendering(vkctx.physicalDevice)) {
+    extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    vkctx.dynamicRendering = true;
+  }
 
   // if we use validation layers, then we enable them
   // otherwise we don't provide any layers
@@ -220,14 +380,77 @@ static void createDevice() {
 #else
       0, nullptr,
 #endif
-      static_cast<uint32_t>(vkctx.deviceExtensions.size()),
-      vkctx.deviceExtensions.data(), &features);
+      static_cast<uint32_t>(extensions.size()), extensions.data(), &features);
+  void* featureChain = nullptr;
+  if (vkctx.bindless) {
+    indexingFeatures.pNext = featureChain;
+    featureChain = &indexingFeatures;
+  }
+  if (vkctx.dynamicRendering) {
+    renderingFeatures.pNext = featureChain;
+    featureChain = &renderingFeatures;
+  }
+  info.pNext = featureChain;
 
   vkctx.device = vkctx.physicalDevice.createDevice(info);
 
+  // extension commands aren't exported by the loader
+  if (vkctx.dynamicRendering) {
+    vkctx.cmdBeginRendering = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(
+        vkctx.device.getProcAddr("vkCmdBeginRenderingKHR"));
+    vkctx.cmdEndRendering = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(
+        vkctx.device.getProcAddr("vkCmdEndRenderingKHR"));
+    if (!vkctx.cmdBeginRendering || !vkctx.cmdEndRendering)
+      throw std::runtime_error("can't load vkCmdBeginRenderingKHR");
+  }
+
   vkctx.graphicsQueue =
       vkctx.device.getQueue(indices.graphicsFamily.value(), 0);
   vkctx.presentQueue = vkctx.device.getQueue(indices.presentFamily.value(), 0);
+
+  // without a dedicated transfer family uploads go through the graphics queue
+  vkctx.graphicsFamily = indices.graphicsFamily.value();
+  vkctx.transferFamily =
+      indices.transferFamily.value_or(indices.graphicsFamily.value());
+  vkctx.transferQueue = vkctx.device.getQueue(vkctx.transferFamily, 0);
+}
+
+// the stencil formats are only there because some devices lack d32
+static void pickDepthFormat() {
+  for (vk::Format format :
+       {vk::Format::eD32Sfloat, vk::Format::eD32SfloatS8Uint,
+        vk::Format::eD24UnormS8Uint}) {
+    auto props = vkctx.physicalDevice.getFormatProperties(format);
+    if (props.optimalTilingFeatures &
+        vk::FormatFeatureFlagBits::eDepthStencilAttachment) {
+      vkctx.depthFormat = format;
+      return;
+    }
+  }
+
+  throw std::runtime_error("can't find a depth format");
+}
+
+// falls back to fewer samples if the device can't render as many color and
+// depth samples as were asked for, only single bits are ever tried so a count
+// that isn't a power of two rounds down
+static void pickSampleCount() {
+  auto limits = vkctx.physicalDevice.getProperties().limits;
+  vk::SampleCountFlags supported = limits.framebufferColorSampleCounts &
+                                   limits.framebufferDepthSampleCounts;
+
+  vkctx.samples = vk::SampleCountFlagBits::e1;
+  for (uint32_t count = 16; count > 1; count /= 2) {
+    auto samples = static_cast<vk::SampleCountFlagBits>(count);
+    if (count <= vkctx.msaa && (supported & samples)) {
+      vkctx.samples = samples;
+      break;
+    }
+  }
+
+  if (vkctx.msaa > 1 && static_cast<uint32_t>(vkctx.samples) != vkctx.msaa)
+    std::cerr << vkctx.msaa << "x msaa isn't supported, using "
+              << static_cast<uint32_t>(vkctx.samples) << "x" << std::endl;
 }
 
 static void createAllocator() {
@@ -250,10 +473,26 @@ chooseSurfaceFormat(const std::vector<vk::SurfaceFormatKHR>& availableFormats) {
   return availableFormats[0];
 }
 
+// the policy's most preferred mode the surface supports, fifo always is
 static vk::PresentModeKHR choosePresentMode(
     const std::vector<vk::PresentModeKHR>& availablePresentModes) {
-  for (const auto& presentMode : availablePresentModes) {
-    if (presentMode == vk::PresentModeKHR::eMailbox) {
+  std::vector<vk::PresentModeKHR> preferred;
+  switch (vkctx.presentPolicy) {
+  case PresentPolicy::Throughput:
+    preferred = {vk::PresentModeKHR::eImmediate, vk::PresentModeKHR::eMailbox,
+                 vk::PresentModeKHR::eFifoRelaxed};
+    break;
+  case PresentPolicy::LowLatency:
+    // never immediate, it would tear where mailbox is missing
+    preferred = {vk::PresentModeKHR::eMailbox};
+    break;
+  case PresentPolicy::Vsync:
+    break;
+  }
+
+  for (const auto& presentMode : preferred) {
+    if (std::find(availablePresentModes.begin(), availablePresentModes.end(),
+                  presentMode) != availablePresentModes.end()) {
       return presentMode;
     }
   }
@@ -282,14 +521,20 @@ chooseExtent(const vk::SurfaceCapabilitiesKHR& capabilities) {
   }
 }
 
-static void createSwapchain() {
+// passing the swapchain being replaced lets the driver hand its resources
+// over to the new one
+static void createSwapchain(vk::SwapchainKHR oldSwapchain = nullptr) {
   auto swapchainSupport = querySwapchainSupport(vkctx.physicalDevice);
 
   auto surfaceFormat = chooseSurfaceFormat(swapchainSupport.formats);
   auto presentMode = choosePresentMode(swapchainSupport.presentModes);
   auto extent = chooseExtent(swapchainSupport.capabilities);
 
+  // throughput wants an image for every frame in flight so acquiring never
+  // waits on the display
   uint32_t imageCount = swapchainSupport.capabilities.minImageCount + 1;
+  if (vkctx.presentPolicy == PresentPolicy::Throughput)
+    imageCount = std::max(imageCount, vkctx.framesInFlight + 1);
   if (swapchainSupport.capabilities.maxImageCount > 0 &&
       imageCount > swapchainSupport.capabilities.maxImageCount) {
     imageCount = swapchainSupport.capabilities.maxImageCount;
@@ -300,7 +545,8 @@ static void createSwapchain() {
       surfaceFormat.colorSpace, extent, 1,
       vk::ImageUsageFlagBits::eColorAttachment, vk::SharingMode::eExclusive, 0,
       nullptr, swapchainSupport.capabilities.currentTransform,
-      vk::CompositeAlphaFlagBitsKHR::eOpaque, presentMode, VK_TRUE, nullptr);
+      vk::CompositeAlphaFlagBitsKHR::eOpaque, presentMode, VK_TRUE,
+      oldSwapchain);
 
   QueueIndices indices = getQueueIndices(vkctx.physicalDevice);
   uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(),
@@ -318,6 +564,25 @@ static void createSwapchain() {
   vkctx.swapchainExtent = extent;
 }
 
+static void createOffscreenImages() {
+  vkctx.swapchainImageFormat = vk::Format::eR8G8B8A8Unorm;
+  vkctx.swapchainExtent = vk::Extent2D(vkctx.WIDTH, vkctx.HEIGHT);
+
+  vkctx.swapchainImages.resize(vkctx.OFFSCREEN_IMAGES);
+  vkctx.offscreenAllocations.resize(vkctx.OFFSCREEN_IMAGES);
+
+  for (uint32_t i = 0; i < vkctx.OFFSCREEN_IMAGES; i++) {
+    vkctx.swapchainImages[i] = createImage(
+        vkctx.swapchainExtent.width, vkctx.swapchainExtent.height,
+        vkctx.swapchainImageFormat, vk::ImageTiling::eOptimal,
+        vk::ImageUsageFlagBits::eColorAttachment |
+            vk::ImageUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        vkctx.offscreenAllocations[i]);
+  }
+  vkctx.offscreenIndex = 0;
+}
+
 static void createImageViews() {
   vkctx.swapchainImageViews.resize(vkctx.swapchainImages.size());
   for (size_t i = 0; i < vkctx.swapchainImages.size(); i++) {
@@ -326,7 +591,7 @@ static void createImageViews() {
   }
 }
 
-static std::vector<char> readFile(const std::string& filename) {
+std::vector<char> readFile(const std::string& filename) {
   std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
   if (!file.is_open()) {
@@ -343,40 +608,190 @@ static std::vector<char> readFile(const std::string& filename) {
   return buffer;
 }
 
-static vk::ShaderModule createShaderModule(const std::vector<char>& code) {
-  vk::ShaderModuleCreateInfo info(
-      {}, code.size(), reinterpret_cast<const uint32_t*>(code.data()));
+static void createPipelineCache() {
+  VkPhysicalDeviceProperties props = vkctx.physicalDevice.getProperties();
+
+  std::vector<char> file;
+  try {
+    file = loadFile(vkctx.pipelineCachePath);
+  } catch (const std::runtime_error&) {
+    // no cache yet, it gets written on shutdown
+  }
+
+  // only hand the driver data that was written by the same device and driver,
+  // anything else is at best useless and at worst crashes buggy drivers
+  PipelineCacheHeader header;
+  bool valid = file.size() >= sizeof(header);
+  if (valid) {
+    std::memcpy(&header, file.data(), sizeof(header));
+    valid = header.magic == PipelineCacheHeader::MAGIC &&
+            header.vendorID == props.vendorID &&
+            header.deviceID == props.deviceID &&
+            header.driverVersion == props.driverVersion &&
+            std::memcmp(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE) ==
+                0 &&
+            header.dataSize == file.size() - sizeof(header);
+  }
+
+  if (!file.empty() && !valid)
+    std::cerr << "pipeline cache is stale, rebuilding it" << std::endl;
+
+  vk::PipelineCacheCreateInfo info;
+  if (valid) {
+    info.initialDataSize = static_cast<size_t>(header.dataSize);
+    info.pInitialData = file.data() + sizeof(header);
+  }
+
+  vkctx.pipelineCache = vkctx.device.createPipelineCache(info);
+}
+
+// writes to a temporary file and renames it over the old cache so a crash
+// halfway through never leaves a truncated cache behind
+static void savePipelineCache() {
+  VkPhysicalDeviceProperties props = vkctx.physicalDevice.getProperties();
+  auto data = vkctx.device.getPipelineCacheData(vkctx.pipelineCache);
+
+  PipelineCacheHeader header;
+  header.magic = PipelineCacheHeader::MAGIC;
+  header.vendorID = props.vendorID;
+  header.deviceID = props.deviceID;
+  header.driverVersion = props.driverVersion;
+  std::memcpy(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+  header.dataSize = data.size();
+
+  std::string tempPath = vkctx.pipelineCachePath + ".tmp";
+  std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+
+  if (!file.is_open()) {
+    std::cerr << "can't write pipeline cache" << std::endl;
+    return;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(data.data()), data.size());
+  file.close();
+
+  if (!file || std::rename(tempPath.c_str(),
+                           vkctx.pipelineCachePath.c_str()) != 0) {
+    std::cerr << "can't write pipeline cache" << std::endl;
+    std::remove(tempPath.c_str());
+  }
+}
+
+static void
+recordPipelineFeedback(const vk::PipelineCreationFeedbackEXT& feedback) {
+  if (!(feedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eValid))
+    return;
+
+  if (feedback.flags &
+      vk::PipelineCreationFeedbackFlagBitsEXT::eApplicationPipelineCacheHit)
+    vkctx.pipelineCacheHits++;
+  else
+    vkctx.pipelineCacheMisses++;
+}
+
+vk::ShaderModule createShaderModule(Shader shader) {
+  ShaderCode code = shaderCode(shader);
+  vk::ShaderModuleCreateInfo info({}, code.size, code.code);
 
   return vkctx.device.createShaderModule(info);
 }
 
+// constant_id i gets values[i], every value is 32 bits like a bool or uint
+// constant, entries just has to outlive the returned info
+vk::SpecializationInfo
+specializationInfo(const std::vector<uint32_t>& values,
+                   std::vector<vk::SpecializationMapEntry>& entries) {
+  entries.clear();
+  for (uint32_t i = 0; i < values.size(); i++)
+    entries.emplace_back(i, i * sizeof(uint32_t), sizeof(uint32_t));
+
+  return vk::SpecializationInfo(static_cast<uint32_t>(entries.size()),
+                                entries.data(),
+                                values.size() * sizeof(uint32_t),
+                                values.data());
+}
+
+// the render graph transitions the attachments and synchronizes with whatever
+// comes before and after, so the render passes neither change their layouts
+// nor have external dependencies, dynamic rendering doesn't need any, after a
+// prepass the main pass keeps its depth, with msaa the swapchain image is
+// only the resolve attachment
 static void createRenderPass() {
+  if (vkctx.dynamicRendering)
+    return;
+
+  bool multisampled = vkctx.samples != vk::SampleCountFlagBits::e1;
+
   vk::AttachmentDescription colorAttachment(
+      {}, vkctx.swapchainImageFormat, vkctx.samples,
+      vk::AttachmentLoadOp::eClear,
+      multisampled ? vk::AttachmentStoreOp::eDontCare
+                   : vk::AttachmentStoreOp::eStore,
+      vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
+      vk::ImageLayout::eColorAttachmentOptimal,
+      vk::ImageLayout::eColorAttachmentOptimal);
+
+  vk::AttachmentDescription depthAttachment(
+      {}, vkctx.depthFormat, vkctx.samples,
+      vkctx.depthPrepass ? vk::AttachmentLoadOp::eLoad
+                         : vk::AttachmentLoadOp::eClear,
+      vk::AttachmentStoreOp::eDontCare, vk::AttachmentLoadOp::eDontCare,
+      vk::AttachmentStoreOp::eDontCare,
+      vk::ImageLayout::eDepthStencilAttachmentOptimal,
+      vk::ImageLayout::eDepthStencilAttachmentOptimal);
+
+  vk::AttachmentDescription resolveAttachment(
       {}, vkctx.swapchainImageFormat, vk::SampleCountFlagBits::e1,
-      vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eStore,
+      vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eStore,
       vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare,
-      vk::ImageLayout::eUndefined, vk::ImageLayout::ePresentSrcKHR);
+      vk::ImageLayout::eColorAttachmentOptimal,
+      vk::ImageLayout::eColorAttachmentOptimal);
 
   vk::AttachmentReference colorRef(0, vk::ImageLayout::eColorAttachmentOptimal);
+  vk::AttachmentReference depthRef(
+      1, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+  vk::AttachmentReference resolveRef(
+      2, vk::ImageLayout::eColorAttachmentOptimal);
 
   vk::SubpassDescription subpass({}, vk::PipelineBindPoint::eGraphics, 0,
-                                 nullptr, 1, &colorRef);
+                                 nullptr, 1, &colorRef,
+                                 multisampled ? &resolveRef : nullptr,
+                                 &depthRef);
 
-  vk::SubpassDependency dependency(
-      VK_SUBPASS_EXTERNAL, 0, vk::PipelineStageFlagBits::eColorAttachmentOutput,
-      vk::PipelineStageFlagBits::eColorAttachmentOutput,
-      static_cast<vk::AccessFlags>(0),
-      vk::AccessFlagBits::eColorAttachmentWrite);
-
-  vk::RenderPassCreateInfo info({}, 1, &colorAttachment, 1, &subpass, 1,
-                                &dependency);
+  std::vector<vk::AttachmentDescription> attachments = {colorAttachment,
+                                                        depthAttachment};
+  if (multisampled)
+    attachments.push_back(resolveAttachment);
+  vk::RenderPassCreateInfo info({}, static_cast<uint32_t>(attachments.size()),
+                                attachments.data(), 1, &subpass, 0, nullptr);
 
   vkctx.renderPass = vkctx.device.createRenderPass(info);
+
+  if (!vkctx.depthPrepass)
+    return;
+
+  depthAttachment.loadOp = vk::AttachmentLoadOp::eClear;
+  depthAttachment.storeOp = vk::AttachmentStoreOp::eStore;
+  depthRef.attachment = 0;
+
+  vk::SubpassDescription depthSubpass({}, vk::PipelineBindPoint::eGraphics, 0,
+                                      nullptr, 0, nullptr, nullptr, &depthRef);
+
+  vk::RenderPassCreateInfo depthInfo({}, 1, &depthAttachment, 1, &depthSubpass,
+                                     0, nullptr);
+
+  vkctx.depthRenderPass = vkctx.device.createRenderPass(depthInfo);
+}
+
+static void destroyRenderPasses() {
+  vkctx.device.destroyRenderPass(vkctx.renderPass);
+  vkctx.device.destroyRenderPass(vkctx.depthRenderPass);
 }
 
 static void createDescriptorSetLayout() {
   vk::DescriptorSetLayoutBinding descriptorBinding(
-      0, vk::DescriptorType::eUniformBuffer, 1,
+      0, vk::DescriptorType::eUniformBufferDynamic, 1,
       vk::ShaderStageFlagBits::eVertex);
 
   vk::DescriptorSetLayoutBinding samplerBinding(
@@ -390,28 +805,73 @@ static void createDescriptorSetLayout() {
       {}, static_cast<uint32_t>(bindings.size()), bindings.data());
 
   vkctx.descriptorLayout = vkctx.device.createDescriptorSetLayout(info);
-}
 
-static void createPipeline() {
-  auto vertCode = readFile("shaders/triangle.vert.spv");
-  auto fragCode = readFile("shaders/triangle.frag.spv");
+  if (!vkctx.bindless)
+    return;
+
+  // update after bind can't be mixed with the dynamic uniform buffer, so the
+  // texture array gets a set of its own
+  vk::DescriptorSetLayoutBinding textureBinding(
+      0, vk::DescriptorType::eCombinedImageSampler, vkctx.bindlessCapacity,
+      vk::ShaderStageFlagBits::eFragment, nullptr);
+
+  vk::DescriptorBindingFlagsEXT bindingFlags =
+      vk::DescriptorBindingFlagBitsEXT::ePartiallyBound |
+      vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind;
+  vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo(1, &bindingFlags);
 
-  auto vertModule = createShaderModule(vertCode);
-  auto fragModule = createShaderModule(fragCode);
+  vk::DescriptorSetLayoutCreateInfo textureInfo(
+      vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT, 1,
+      &textureBinding);
+  textureInfo.pNext = &flagsInfo;
+
+  vkctx.textureLayout = vkctx.device.createDescriptorSetLayout(textureInfo);
+}
+
+// every graphics pipeline shares the same fixed function state, the rest
+// comes from the state, the fragment shaders are specialized for its shading
+// view so they never branch on it, safe to call from jobs since it only reads
+// parts of vkctx that don't change after startup
+vk::Pipeline buildGraphicsPipeline(const PipelineState& state) {
+  // the prepass only has the vertex shader and the depth attachment
+  bool prepass = state.depth == DepthMode::Prepass;
+  uint32_t stageCount = prepass ? 1 : 2;
+  uint32_t colorCount = prepass ? 0 : 1;
+
+  auto vertModule = createShaderModule(state.vert);
+  vk::ShaderModule fragModule;
+  if (!prepass)
+    fragModule = createShaderModule(state.frag);
+
+  std::vector<uint32_t> fragConstants = {static_cast<uint32_t>(state.view)};
+  std::vector<vk::SpecializationMapEntry> fragEntries;
+  vk::SpecializationInfo fragSpecialization =
+      specializationInfo(fragConstants, fragEntries);
 
   vk::PipelineShaderStageCreateInfo vertShaderInfo(
       {}, vk::ShaderStageFlagBits::eVertex, vertModule, "main");
 
   vk::PipelineShaderStageCreateInfo fragShaderInfo(
-      {}, vk::ShaderStageFlagBits::eFragment, fragModule, "main");
+      {}, vk::ShaderStageFlagBits::eFragment, fragModule, "main",
+      &fragSpecialization);
 
   vk::PipelineShaderStageCreateInfo shaderStages[] = {vertShaderInfo,
                                                       fragShaderInfo};
-  auto bindingDescription = Vertex::getBindingDescription();
-  auto attributeDescriptions = Vertex::getAttributeDescription();
+  std::vector<vk::VertexInputBindingDescription> bindingDescriptions = {
+      meshBindingDescription(state.vertexLayout)};
+  auto attributeDescriptions = meshAttributeDescriptions(state.vertexLayout);
+
+  if (state.instanced) {
+    auto instanceAttributes = InstanceData::getAttributeDescription();
+    bindingDescriptions.push_back(InstanceData::getBindingDescription());
+    attributeDescriptions.insert(attributeDescriptions.end(),
+                                 instanceAttributes.begin(),
+                                 instanceAttributes.end());
+  }
 
   vk::PipelineVertexInputStateCreateInfo vertexInputInfo(
-      {}, 1, &bindingDescription,
+      {}, static_cast<uint32_t>(bindingDescriptions.size()),
+      bindingDescriptions.data(),
       static_cast<uint32_t>(attributeDescriptions.size()),
       attributeDescriptions.data());
 
@@ -428,7 +888,7 @@ static void createPipeline() {
       0.0f, 0.0f, 0.0f, 1.0f);
 
   vk::PipelineMultisampleStateCreateInfo multisampleInfo(
-      {}, vk::SampleCountFlagBits::e1, VK_FALSE, 1.0f, nullptr, VK_FALSE,
+      {}, state.samples, VK_FALSE, 1.0f, nullptr, VK_FALSE,
       VK_FALSE);
 
   vk::PipelineColorBlendAttachmentState colorBlendAttachment(VK_FALSE);
@@ -437,46 +897,142 @@ static void createPipeline() {
       vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA);
 
   vk::PipelineColorBlendStateCreateInfo colorBlendInfo(
-      {}, VK_FALSE, vk::LogicOp::eCopy, 1, &colorBlendAttachment);
+      {}, VK_FALSE, vk::LogicOp::eCopy, colorCount, &colorBlendAttachment);
+
+  vk::PipelineDepthStencilStateCreateInfo depthInfo(
+      {}, VK_TRUE, state.depth != DepthMode::Equal,
+      state.depth == DepthMode::Equal ? vk::CompareOp::eEqual
+                                      : vk::CompareOp::eLess);
 
   vk::DynamicState dynamicStates[] = {vk::DynamicState::eViewport,
                                       vk::DynamicState::eScissor};
 
   vk::PipelineDynamicStateCreateInfo dynamicInfo({}, 2, dynamicStates);
 
-  vk::PipelineLayoutCreateInfo pipelineLayoutInfo(
-      {}, 1, &vkctx.descriptorLayout, 0, nullptr);
-
-  vkctx.pipelineLayout = vkctx.device.createPipelineLayout(pipelineLayoutInfo);
-
   vk::GraphicsPipelineCreateInfo pipelineInfo(
-      {}, 2, shaderStages, &vertexInputInfo, &inputAssemblyInfo, nullptr,
-      &viewportState, &rasterizerInfo, &multisampleInfo, nullptr,
-      &colorBlendInfo, &dynamicInfo, vkctx.pipelineLayout, vkctx.renderPass, 0);
+      {}, stageCount, shaderStages, &vertexInputInfo, &inputAssemblyInfo,
+      nullptr, &viewportState, &rasterizerInfo, &multisampleInfo, &depthInfo,
+      &colorBlendInfo, &dynamicInfo, state.layout, state.renderPass, 0);
+
+  // without a render pass the pipeline gets the attachment formats instead
+  vk::PipelineRenderingCreateInfoKHR renderingInfo(
+      0, colorCount, &state.colorFormat, state.depthFormat);
+  if (!state.renderPass)
+    pipelineInfo.pNext = &renderingInfo;
+
+  vk::PipelineCreationFeedbackEXT pipelineFeedback;
+  std::array<vk::PipelineCreationFeedbackEXT, 2> stageFeedback;
+  vk::PipelineCreationFeedbackCreateInfoEXT feedbackInfo(
+      &pipelineFeedback, stageCount, stageFeedback.data());
+  if (vkctx.pipelineFeedback) {
+    feedbackInfo.pNext = pipelineInfo.pNext;
+    pipelineInfo.pNext = &feedbackInfo;
+  }
+
+  vk::Pipeline pipeline =
+      vkctx.device.createGraphicsPipeline(vkctx.pipelineCache, pipelineInfo);
 
-  vkctx.pipeline = vkctx.device.createGraphicsPipeline(nullptr, pipelineInfo);
+  if (vkctx.pipelineFeedback)
+    recordPipelineFeedback(pipelineFeedback);
 
   vkctx.device.destroyShaderModule(vertModule);
-  vkctx.device.destroyShaderModule(fragModule);
+  if (fragModule)
+    vkctx.device.destroyShaderModule(fragModule);
+
+  return pipeline;
+}
+
+// the textured pipelines are built right away, the ones for other shading
+// views on jobs, the prepass one only for the path that's drawn
+static void requestScenePipelines() {
+  PipelineState state;
+  state.layout = vkctx.pipelineLayout;
+  state.renderPass = vkctx.renderPass;
+  state.colorFormat = vkctx.swapchainImageFormat;
+  state.depthFormat = vkctx.depthFormat;
+  state.depth = vkctx.depthPrepass ? DepthMode::Equal : DepthMode::TestWrite;
+  state.samples = vkctx.samples;
+  state.vertexLayout = getMesh(vkctx.sceneMesh).layout;
+  state.vert = Shader::TriangleVert;
+  state.frag = vkctx.bindless ? Shader::BindlessFrag : Shader::TriangleFrag;
+  vkctx.pipeline = requestViewPipeline(state);
+
+  // the same layout works, the instanced shaders just don't use the push
+  // constant
+  if (vkctx.instanced) {
+    state.vert = Shader::InstancedVert;
+    state.frag = vkctx.bindless ? Shader::InstancedBindlessFrag
+                                : Shader::InstancedFrag;
+    state.instanced = true;
+    vkctx.instancedPipeline = requestViewPipeline(state);
+  }
+
+  if (vkctx.depthPrepass)
+    vkctx.prepassPipeline = buildPrepassPipeline(state);
 }
 
-static void createFramebuffers() {
+static void requestPipelines() {
+  requestScenePipelines();
+  if (vkctx.gpuDriven)
+    requestGpuPipeline();
+}
+
+static void createPipeline() {
+  // the bindless fragment shader takes the draw's texture slot as a push
+  // constant
+  std::vector<vk::DescriptorSetLayout> setLayouts = {vkctx.descriptorLayout};
+  vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eFragment,
+                                          0, sizeof(uint32_t));
+  if (vkctx.bindless)
+    setLayouts.push_back(vkctx.textureLayout);
+
+  vk::PipelineLayoutCreateInfo pipelineLayoutInfo(
+      {}, static_cast<uint32_t>(setLayouts.size()), setLayouts.data(),
+      vkctx.bindless ? 1 : 0, &pushConstantRange);
+
+  vkctx.pipelineLayout = vkctx.device.createPipelineLayout(pipelineLayoutInfo);
+  requestScenePipelines();
+}
+
+// the depth and multisampled color views are the frame graph's, so these are
+// created after it, without msaa the color view is null
+static void createFramebuffers(vk::ImageView depthView,
+                               vk::ImageView colorView) {
+  if (vkctx.dynamicRendering)
+    return;
+
   vkctx.framebuffers.resize(vkctx.swapchainImageViews.size());
   for (size_t i = 0; i < vkctx.swapchainImageViews.size(); i++) {
-    vk::ImageView attachments[] = {vkctx.swapchainImageViews[i]};
+    std::vector<vk::ImageView> attachments = {vkctx.swapchainImageViews[i],
+                                              depthView};
+    if (colorView) {
+      attachments[0] = colorView;
+      attachments.push_back(vkctx.swapchainImageViews[i]);
+    }
 
-    vk::FramebufferCreateInfo info({}, vkctx.renderPass, 1, attachments,
+    vk::FramebufferCreateInfo info({}, vkctx.renderPass,
+                                   static_cast<uint32_t>(attachments.size()),
+                                   attachments.data(),
                                    vkctx.swapchainExtent.width,
                                    vkctx.swapchainExtent.height, 1);
 
     vkctx.framebuffers[i] = vkctx.device.createFramebuffer(info);
   }
+
+  if (vkctx.depthPrepass) {
+    vk::FramebufferCreateInfo info({}, vkctx.depthRenderPass, 1, &depthView,
+                                   vkctx.swapchainExtent.width,
+                                   vkctx.swapchainExtent.height, 1);
+    vkctx.depthFramebuffer = vkctx.device.createFramebuffer(info);
+  }
 }
 
 static void createCommandPool() {
   QueueIndices indices = getQueueIndices(vkctx.physicalDevice);
 
-  vk::CommandPoolCreateInfo info({}, indices.graphicsFamily.value());
+  vk::CommandPoolCreateInfo info(
+      vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+      indices.graphicsFamily.value());
   vkctx.commandPool = vkctx.device.createCommandPool(info);
 }
 
@@ -498,146 +1054,130 @@ vk::Buffer createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage,
   return output;
 }
 
-vk::CommandBuffer beginCommands() {
-  vk::CommandBufferAllocateInfo allocInfo(vkctx.commandPool,
-                                          vk::CommandBufferLevel::ePrimary, 1);
-  vk::CommandBuffer commandBuffer =
-      vkctx.device.allocateCommandBuffers(allocInfo)[0];
-
-  vk::CommandBufferBeginInfo beginInfo(
-      vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-  commandBuffer.begin(beginInfo);
+// one persistently mapped arena per frame in flight, per draw uniforms are
+// suballocated from it and bound with dynamic offsets
+static void createUniformBuffers() {
+  auto limits = vkctx.physicalDevice.getProperties().limits;
+  vkctx.uniformAlignment = std::max<vk::DeviceSize>(
+      limits.minUniformBufferOffsetAlignment, 16);
+
+  // the per draw path takes a slot for every draw each frame
+  vk::DeviceSize stride = (sizeof(MVP) + vkctx.uniformAlignment - 1) /
+                          vkctx.uniformAlignment * vkctx.uniformAlignment;
+  vkctx.uniformArenaSize =
+      stride * std::max<uint32_t>(vkctx.drawCount, 1) +
+      vkctx.UNIFORM_ARENA_SIZE;
+
+  vkctx.uniformBuffers.resize(vkctx.framesInFlight);
+  vkctx.uniformAllocations.resize(vkctx.framesInFlight);
+  vkctx.uniformData.resize(vkctx.framesInFlight);
+
+  for (size_t i = 0; i < vkctx.framesInFlight; i++) {
+    VmaAllocation allocation;
+    vkctx.uniformBuffers[i] =
+        createBuffer(vkctx.uniformArenaSize,
+                     vk::BufferUsageFlagBits::eUniformBuffer,
+                     vk::MemoryPropertyFlagBits::eHostVisible |
+                         vk::MemoryPropertyFlagBits::eHostCoherent,
+                     VMA_MEMORY_USAGE_CPU_TO_GPU, allocation);
+    vkctx.uniformAllocations[i] = allocation;
 
-  return commandBuffer;
+    void* data;
+    vmaMapMemory(vkctx.allocator, allocation, &data);
+    vkctx.uniformData[i] = static_cast<uint8_t*>(data);
+  }
 }
 
-void endCommands(vk::CommandBuffer& buffer) {
-  buffer.end();
-
-  vk::SubmitInfo submitInfo;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &buffer;
+static void createInstanceBuffers() {
+  vk::DeviceSize size =
+      sizeof(InstanceData) * std::max<uint32_t>(vkctx.drawCount, 1);
 
-  vkctx.graphicsQueue.submit(1, &submitInfo, nullptr);
-  vkctx.graphicsQueue.waitIdle();
+  vkctx.instanceBuffers.resize(vkctx.framesInFlight);
+  vkctx.instanceAllocations.resize(vkctx.framesInFlight);
+  vkctx.instanceData.resize(vkctx.framesInFlight);
 
-  vkctx.device.freeCommandBuffers(vkctx.commandPool, 1, &buffer);
-}
+  for (size_t i = 0; i < vkctx.framesInFlight; i++) {
+    vkctx.instanceBuffers[i] =
+        createBuffer(size, vk::BufferUsageFlagBits::eVertexBuffer,
+                     vk::MemoryPropertyFlagBits::eHostVisible |
+                         vk::MemoryPropertyFlagBits::eHostCoherent,
+                     VMA_MEMORY_USAGE_CPU_TO_GPU, vkctx.instanceAllocations[i]);
 
-void copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer,
-                vk::DeviceSize size) {
-  vk::CommandBuffer commandBuffer = beginCommands();
-  vk::BufferCopy copy(0, 0, size);
-  commandBuffer.copyBuffer(srcBuffer, dstBuffer, copy);
-  endCommands(commandBuffer);
+    void* data;
+    vmaMapMemory(vkctx.allocator, vkctx.instanceAllocations[i], &data);
+    vkctx.instanceData[i] = static_cast<uint8_t*>(data);
+  }
 }
 
-static void createTextureSampler() {
-  vk::SamplerCreateInfo info(
-      {}, vk::Filter::eLinear, vk::Filter::eLinear,
-      vk::SamplerMipmapMode::eLinear, vk::SamplerAddressMode::eRepeat,
-      vk::SamplerAddressMode::eRepeat, vk::SamplerAddressMode::eRepeat, 0.0f,
-      VK_TRUE, 16, VK_FALSE, vk::CompareOp::eAlways, 0.0f, 0.0f,
-      vk::BorderColor::eIntOpaqueBlack, VK_FALSE);
-
-  vkctx.textureSampler = vkctx.device.createSampler(info);
+static void cleanupInstanceBuffers() {
+  for (size_t i = 0; i < vkctx.instanceBuffers.size(); i++) {
+    vmaUnmapMemory(vkctx.allocator, vkctx.instanceAllocations[i]);
+    vmaDestroyBuffer(vkctx.allocator, vkctx.instanceBuffers[i],
+                     vkctx.instanceAllocations[i]);
+  }
+  vkctx.instanceBuffers.clear();
+  vkctx.instanceAllocations.clear();
+  vkctx.instanceData.clear();
 }
 
-static void createVertexBuffer() {
-  vk::DeviceSize bufferSize = sizeof(Vertex) * vertices.size();
-  VmaAllocation stagingAllocation;
-  auto stagingBuffer =
-      createBuffer(bufferSize, vk::BufferUsageFlagBits::eTransferSrc,
-                   vk::MemoryPropertyFlagBits::eHostVisible |
-                       vk::MemoryPropertyFlagBits::eHostCoherent,
-                   VMA_MEMORY_USAGE_CPU_ONLY, stagingAllocation);
-
-  VmaAllocationInfo allocInfo;
-
-  vmaGetAllocationInfo(vkctx.allocator, stagingAllocation, &allocInfo);
-
-  void* data = vkctx.device.mapMemory(allocInfo.deviceMemory, allocInfo.offset,
-                                      allocInfo.size);
-  SDL_memcpy(data, vertices.data(), bufferSize);
-  vkctx.device.unmapMemory(allocInfo.deviceMemory);
-
-  vkctx.vertexBuffer =
-      createBuffer(bufferSize,
-                   vk::BufferUsageFlagBits::eTransferDst |
-                       vk::BufferUsageFlagBits::eVertexBuffer,
-                   vk::MemoryPropertyFlagBits::eDeviceLocal,
-                   VMA_MEMORY_USAGE_GPU_ONLY, vkctx.vertexAllocation);
-
-  copyBuffer(stagingBuffer, vkctx.vertexBuffer, bufferSize);
-
-  vmaDestroyBuffer(vkctx.allocator, stagingBuffer, stagingAllocation);
+static void cleanupUniformBuffers() {
+  for (size_t i = 0; i < vkctx.uniformBuffers.size(); i++) {
+    vmaUnmapMemory(vkctx.allocator, vkctx.uniformAllocations[i]);
+    vmaDestroyBuffer(vkctx.allocator, vkctx.uniformBuffers[i],
+                     vkctx.uniformAllocations[i]);
+  }
 }
 
-static void createIndexBuffer() {
-  vk::DeviceSize bufferSize = sizeof(uint16_t) * indices.size();
-
-  VmaAllocation stagingAllocation;
-  auto stagingBuffer =
-      createBuffer(bufferSize, vk::BufferUsageFlagBits::eTransferSrc,
-                   vk::MemoryPropertyFlagBits::eHostVisible |
-                       vk::MemoryPropertyFlagBits::eHostCoherent,
-                   VMA_MEMORY_USAGE_CPU_ONLY, stagingAllocation);
-
-  VmaAllocationInfo allocInfo;
-
-  vmaGetAllocationInfo(vkctx.allocator, stagingAllocation, &allocInfo);
-
-  void* data = vkctx.device.mapMemory(allocInfo.deviceMemory, allocInfo.offset,
-                                      allocInfo.size);
-  SDL_memcpy(data, indices.data(), bufferSize);
-  vkctx.device.unmapMemory(allocInfo.deviceMemory);
+// reserves size bytes in the current frame's uniform arena, offset is the
+// dynamic offset to bind it with, only valid until this frame slot comes
+// around again
+uint8_t* allocateUniforms(vk::DeviceSize size, uint32_t& offset) {
+  vk::DeviceSize aligned = (vkctx.uniformHead + vkctx.uniformAlignment - 1) /
+                           vkctx.uniformAlignment * vkctx.uniformAlignment;
 
-  vkctx.indexBuffer =
-      createBuffer(bufferSize,
-                   vk::BufferUsageFlagBits::eTransferDst |
-                       vk::BufferUsageFlagBits::eIndexBuffer,
-                   vk::MemoryPropertyFlagBits::eDeviceLocal,
-                   VMA_MEMORY_USAGE_GPU_ONLY, vkctx.indexAllocation);
+  if (aligned + size > vkctx.uniformArenaSize)
+    throw std::runtime_error("uniform arena is full");
 
-  copyBuffer(stagingBuffer, vkctx.indexBuffer, bufferSize);
+  vkctx.uniformHead = aligned + size;
+  offset = static_cast<uint32_t>(aligned);
 
-  vmaDestroyBuffer(vkctx.allocator, stagingBuffer, stagingAllocation);
+  return vkctx.uniformData[vkctx.currentFrame] + aligned;
 }
 
-static void createUniformBuffers() {
-  vk::DeviceSize bufferSize = sizeof(MVP);
-  vkctx.uniformBuffers.resize(vkctx.swapchainImages.size());
-  vkctx.uniformAllocations.resize(vkctx.swapchainImages.size());
+uint32_t pushUniforms(const void* data, vk::DeviceSize size) {
+  uint32_t offset;
+  SDL_memcpy(allocateUniforms(size, offset), data, static_cast<size_t>(size));
 
-  for (size_t i = 0; i < vkctx.swapchainImages.size(); i++) {
-    VmaAllocation allocation;
-    vkctx.uniformBuffers[i] =
-        createBuffer(bufferSize, vk::BufferUsageFlagBits::eUniformBuffer,
-                     vk::MemoryPropertyFlagBits::eHostVisible |
-                         vk::MemoryPropertyFlagBits::eHostCoherent,
-                     VMA_MEMORY_USAGE_CPU_TO_GPU, allocation);
-    vkctx.uniformAllocations[i] = allocation;
-  }
+  return offset;
 }
 
 static void createDescriptorPool() {
   std::array<vk::DescriptorPoolSize, 2> poolSizes;
-  poolSizes[0] = vk::DescriptorPoolSize(
-      vk::DescriptorType::eUniformBuffer,
-      static_cast<uint32_t>(vkctx.swapchainImages.size()));
+  poolSizes[0] = vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic,
+                                        vkctx.framesInFlight);
   poolSizes[1] = vk::DescriptorPoolSize(
-      vk::DescriptorType::eCombinedImageSampler,
-      static_cast<uint32_t>(vkctx.swapchainImages.size()));
+      vk::DescriptorType::eCombinedImageSampler, vkctx.framesInFlight);
 
-  vk::DescriptorPoolCreateInfo info(
-      {}, static_cast<uint32_t>(vkctx.swapchainImages.size()),
-      static_cast<uint32_t>(poolSizes.size()), poolSizes.data());
+  vk::DescriptorPoolCreateInfo info({}, vkctx.framesInFlight,
+                                    static_cast<uint32_t>(poolSizes.size()),
+                                    poolSizes.data());
 
   vkctx.descriptorPool = vkctx.device.createDescriptorPool(info);
+
+  if (!vkctx.bindless)
+    return;
+
+  vk::DescriptorPoolSize textureSize(vk::DescriptorType::eCombinedImageSampler,
+                                     vkctx.bindlessCapacity);
+  vk::DescriptorPoolCreateInfo textureInfo(
+      vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT, 1, 1,
+      &textureSize);
+
+  vkctx.texturePool = vkctx.device.createDescriptorPool(textureInfo);
 }
 
 static void createDescriptorSets() {
-  std::vector<vk::DescriptorSetLayout> layouts(vkctx.swapchainImages.size(),
+  std::vector<vk::DescriptorSetLayout> layouts(vkctx.framesInFlight,
                                                vkctx.descriptorLayout);
 
   vk::DescriptorSetAllocateInfo allocInfo(vkctx.descriptorPool,
@@ -647,15 +1187,18 @@ static void createDescriptorSets() {
   vkctx.descriptorSets = vkctx.device.allocateDescriptorSets(allocInfo);
 
   for (size_t i = 0; i < layouts.size(); i++) {
+    // the range is one draw's worth, the dynamic offset picks which one
     vk::DescriptorBufferInfo bufferInfo(vkctx.uniformBuffers[i], 0,
                                         sizeof(MVP));
-    vk::DescriptorImageInfo imageInfo(vkctx.textureSampler,
-                                      vkctx.textureImageView,
+    // bindTextures swaps in the real texture once it's loaded
+    vk::DescriptorImageInfo imageInfo(getSampler(vkctx.textureSampler),
+                                      vkctx.placeholderTexture.view,
                                       vk::ImageLayout::eShaderReadOnlyOptimal);
     std::array<vk::WriteDescriptorSet, 2> descriptorWrites;
     descriptorWrites[0] = vk::WriteDescriptorSet(
-        vkctx.descriptorSets[i], 0, 0, 1, vk::DescriptorType::eUniformBuffer,
-        nullptr, &bufferInfo, nullptr);
+        vkctx.descriptorSets[i], 0, 0, 1,
+        vk::DescriptorType::eUniformBufferDynamic, nullptr, &bufferInfo,
+        nullptr);
     descriptorWrites[1] =
         vk::WriteDescriptorSet(vkctx.descriptorSets[i], 1, 0, 1,
                                vk::DescriptorType::eCombinedImageSampler,
@@ -664,54 +1207,304 @@ static void createDescriptorSets() {
         static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(),
         0, nullptr);
   }
+
+  vkctx.boundTextures.assign(layouts.size(), vkctx.placeholderTexture.view);
+
+  if (!vkctx.bindless)
+    return;
+
+  // one set shared by every frame, slots are only written once and never
+  // while a frame could be using them
+  vk::DescriptorSetAllocateInfo textureAllocInfo(vkctx.texturePool, 1,
+                                                 &vkctx.textureLayout);
+  vkctx.textureSet = vkctx.device.allocateDescriptorSets(textureAllocInfo)[0];
+  writeTextureSlot(0, vkctx.placeholderTexture.view);
+}
+
+static void createTimestampPool() {
+  if (!vkctx.timestamps)
+    return;
+
+  QueueIndices indices = getQueueIndices(vkctx.physicalDevice);
+  auto queueFamilies = vkctx.physicalDevice.getQueueFamilyProperties();
+  auto limits = vkctx.physicalDevice.getProperties().limits;
+
+  if (queueFamilies[indices.graphicsFamily.value()].timestampValidBits == 0 ||
+      limits.timestampPeriod == 0.0f) {
+    std::cerr << "timestamps aren't supported, disabling gpu timing"
+              << std::endl;
+    vkctx.timestamps = false;
+    return;
+  }
+
+  vkctx.timestampPeriod = limits.timestampPeriod;
+
+  vk::QueryPoolCreateInfo info({}, vk::QueryType::eTimestamp,
+                               vkctx.framesInFlight * 2);
+  vkctx.timestampPool = vkctx.device.createQueryPool(info);
+  vkctx.timestampsPending.assign(vkctx.framesInFlight, false);
+}
+
+static void collectTimestamps(uint32_t frame) {
+  if (!vkctx.timestamps || !vkctx.timestampsPending[frame])
+    return;
+
+  std::array<uint64_t, 2> ticks;
+  vk::Result result = vkctx.device.getQueryPoolResults(
+      vkctx.timestampPool, frame * 2, 2, sizeof(ticks), ticks.data(),
+      sizeof(uint64_t),
+      vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+  vkctx.timestampsPending[frame] = false;
+
+  if (result != vk::Result::eSuccess)
+    return;
+
+  // timestampPeriod is in nanoseconds per tick, store milliseconds
+  vkctx.gpuFrameTimes.push_back(static_cast<double>(ticks[1] - ticks[0]) *
+                                vkctx.timestampPeriod / 1e6);
+}
+
+// the device features were checked when it was created
+static void createOverdrawPool() {
+  if (!vkctx.overdrawStats)
+    return;
+
+  vk::QueryPoolCreateInfo info(
+      {}, vk::QueryType::ePipelineStatistics, vkctx.framesInFlight,
+      vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations);
+  vkctx.overdrawPool = vkctx.device.createQueryPool(info);
+  vkctx.overdrawPending.assign(vkctx.framesInFlight, false);
+}
+
+// helper invocations and multisampling can push it up a little, 1 means
+// every pixel was shaded once
+static void collectOverdraw(uint32_t frame) {
+  if (!vkctx.overdrawStats || !vkctx.overdrawPending[frame])
+    return;
+
+  uint64_t invocations;
+  vk::Result result = vkctx.device.getQueryPoolResults(
+      vkctx.overdrawPool, frame, 1, sizeof(invocations), &invocations,
+      sizeof(uint64_t),
+      vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+  vkctx.overdrawPending[frame] = false;
+
+  if (result != vk::Result::eSuccess)
+    return;
+
+  double pixels = static_cast<double>(vkctx.swapchainExtent.width) *
+                  vkctx.swapchainExtent.height;
+  vkctx.overdraw.push_back(static_cast<double>(invocations) / pixels);
+}
+
+// reads back any timestamps and overdraw counts that drawFrame hasn't
+// collected yet, the device has to be idle before calling this
+void flushTimestamps() {
+  for (uint32_t i = 0; i < vkctx.timestampsPending.size(); i++)
+    collectTimestamps(i);
+  for (uint32_t i = 0; i < vkctx.overdrawPending.size(); i++)
+    collectOverdraw(i);
 }
 
+// command buffers are recorded every frame since the uniform offsets change,
+// so there is one per frame in flight instead of one per framebuffer
 static void createCommandBuffers() {
-  vk::CommandBufferAllocateInfo allocInfo(
-      vkctx.commandPool, vk::CommandBufferLevel::ePrimary,
-      static_cast<uint32_t>(vkctx.framebuffers.size()));
+  vk::CommandBufferAllocateInfo allocInfo(vkctx.commandPool,
+                                          vk::CommandBufferLevel::ePrimary,
+                                          vkctx.framesInFlight);
   vkctx.commandBuffers = vkctx.device.allocateCommandBuffers(allocInfo);
+}
 
-  for (size_t i = 0; i < vkctx.commandBuffers.size(); i++) {
-    vk::CommandBufferBeginInfo beginInfo;
-    const auto& buffer = vkctx.commandBuffers[i];
-    buffer.begin(beginInfo);
+// the frame's passes, built along with the swapchain since transient
+// attachments follow its extent, the swapchain image and the frame's
+// indirect buffer are bound every frame
+static RenderGraph frameGraph;
+static uint32_t graphTarget;
+static uint32_t graphDepth;
+// only with msaa
+static uint32_t graphColor;
+static uint32_t graphIndirect;
+// the swapchain image being recorded
+static uint32_t graphImageIndex;
+
+// with dynamic rendering the attachments are set up right here instead of
+// through a framebuffer, the prepass only has the depth attachment
+static void beginRendering(vk::CommandBuffer buffer,
+                           vk::SubpassContents contents, bool prepass) {
+  std::array<vk::ClearValue, 2> clearValues = {
+      vk::ClearColorValue(std::array<float, 4>({0.0f, 0.0f, 0.0f, 1.0f})),
+      vk::ClearDepthStencilValue(1.0f, 0)};
+  vk::Rect2D renderArea({0, 0}, vkctx.swapchainExtent);
+
+  if (!vkctx.dynamicRendering) {
+    vk::RenderPassBeginInfo renderPassInfo(
+        vkctx.renderPass, vkctx.framebuffers[graphImageIndex], renderArea,
+        static_cast<uint32_t>(clearValues.size()), clearValues.data());
+    if (prepass) {
+      renderPassInfo.renderPass = vkctx.depthRenderPass;
+      renderPassInfo.framebuffer = vkctx.depthFramebuffer;
+      renderPassInfo.clearValueCount = 1;
+      renderPassInfo.pClearValues = &clearValues[1];
+    }
+    buffer.beginRenderPass(&renderPassInfo, contents);
+    return;
+  }
 
-    vk::ClearValue clearValue(std::array<float, 4>({0.0f, 0.0f, 0.0f, 1.0f}));
+  vk::RenderingAttachmentInfoKHR colorAttachment(
+      vkctx.swapchainImageViews[graphImageIndex],
+      vk::ImageLayout::eColorAttachmentOptimal, vk::ResolveModeFlagBits::eNone,
+      nullptr, vk::ImageLayout::eUndefined, vk::AttachmentLoadOp::eClear,
+      vk::AttachmentStoreOp::eStore, clearValues[0]);
+
+  // the samples are averaged into the swapchain image and thrown away
+  if (vkctx.samples != vk::SampleCountFlagBits::e1) {
+    colorAttachment.imageView = graphImageView(frameGraph, graphColor);
+    colorAttachment.resolveMode = vk::ResolveModeFlagBits::eAverage;
+    colorAttachment.resolveImageView =
+        vkctx.swapchainImageViews[graphImageIndex];
+    colorAttachment.resolveImageLayout =
+        vk::ImageLayout::eColorAttachmentOptimal;
+    colorAttachment.storeOp = vk::AttachmentStoreOp::eDontCare;
+  }
 
-    vk::RenderPassBeginInfo renderPassInfo(
-        vkctx.renderPass, vkctx.framebuffers[i],
-        vk::Rect2D({0, 0}, vkctx.swapchainExtent), 1, &clearValue);
-
-    buffer.beginRenderPass(&renderPassInfo, vk::SubpassContents::eInline);
-    buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, vkctx.pipeline);
-
-    vk::Viewport viewport(
-        0.0f, 0.0f, static_cast<float>(vkctx.swapchainExtent.width),
-        static_cast<float>(vkctx.swapchainExtent.height), 0.0f, 1.0f);
-
-    vk::Rect2D scissor({0, 0}, vkctx.swapchainExtent);
-
-    buffer.setScissor(0, 1, &scissor);
-    buffer.setViewport(0, 1, &viewport);
-    buffer.bindVertexBuffers(0, std::array<vk::Buffer, 1>({vkctx.vertexBuffer}),
-                             {0});
-    buffer.bindIndexBuffer(vkctx.indexBuffer, 0, vk::IndexType::eUint16);
-    buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-                              vkctx.pipelineLayout, 0, 1,
-                              &vkctx.descriptorSets[i], 0, nullptr);
-    buffer.drawIndexed(static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+  // the main pass keeps what the prepass wrote
+  bool keepDepth = vkctx.depthPrepass && !prepass;
+  vk::RenderingAttachmentInfoKHR depthAttachment(
+      graphImageView(frameGraph, graphDepth),
+      vk::ImageLayout::eDepthStencilAttachmentOptimal,
+      vk::ResolveModeFlagBits::eNone, nullptr, vk::ImageLayout::eUndefined,
+      keepDepth ? vk::AttachmentLoadOp::eLoad : vk::AttachmentLoadOp::eClear,
+      prepass ? vk::AttachmentStoreOp::eStore
+              : vk::AttachmentStoreOp::eDontCare,
+      clearValues[1]);
+
+  vk::RenderingInfoKHR renderingInfo(
+      contents == vk::SubpassContents::eSecondaryCommandBuffers
+          ? vk::RenderingFlagBitsKHR::eContentsSecondaryCommandBuffers
+          : vk::RenderingFlagsKHR(),
+      renderArea, 1, 0, prepass ? 0 : 1, &colorAttachment, &depthAttachment);
+
+  vkctx.cmdBeginRendering(
+      static_cast<VkCommandBuffer>(buffer),
+      reinterpret_cast<const VkRenderingInfoKHR*>(&renderingInfo));
+}
+
+static void endRendering(vk::CommandBuffer buffer) {
+  if (vkctx.dynamicRendering)
+    vkctx.cmdEndRendering(static_cast<VkCommandBuffer>(buffer));
+  else
     buffer.endRenderPass();
+}
+
+// the gpu driven path is a single indirect draw, not worth a secondary
+static void recordScene(vk::CommandBuffer buffer, bool prepass) {
+  if (vkctx.gpuDriven) {
+    beginRendering(buffer, vk::SubpassContents::eInline, prepass);
+    recordIndirectDraws(buffer, prepass);
+  } else {
+    beginRendering(buffer, vk::SubpassContents::eSecondaryCommandBuffers,
+                   prepass);
+    recordDraws(buffer, graphImageIndex, prepass);
+  }
+  endRendering(buffer);
+}
+
+static void recordDepthPrepass(vk::CommandBuffer buffer) {
+  recordScene(buffer, true);
+}
+
+// the overdraw query only counts the main pass, the prepass has no fragment
+// shader anyway
+static void recordRenderPass(vk::CommandBuffer buffer) {
+  if (vkctx.overdrawStats)
+    buffer.beginQuery(vkctx.overdrawPool, vkctx.currentFrame, {});
+  recordScene(buffer, false);
+  if (vkctx.overdrawStats)
+    buffer.endQuery(vkctx.overdrawPool, vkctx.currentFrame);
+}
+
+// headless images are left ready to be copied out, the depth and
+// multisampled color images only live through the frame, the resolve counts
+// as a color attachment write to the swapchain image
+static void buildFrameGraph() {
+  bool multisampled = vkctx.samples != vk::SampleCountFlagBits::e1;
+
+  graphTarget = importGraphImage(
+      frameGraph, "swapchain image", GraphAccess::Acquire,
+      vkctx.headless ? GraphAccess::TransferRead : GraphAccess::Present);
+  graphDepth = addGraphImage(frameGraph, "depth", vkctx.depthFormat,
+                             vkctx.swapchainExtent, vkctx.samples);
+
+  std::vector<GraphUse> prepassUses = {
+      {graphDepth, GraphAccess::DepthAttachment}};
+  std::vector<GraphUse> renderUses = {
+      {graphTarget, GraphAccess::ColorAttachment},
+      {graphDepth, GraphAccess::DepthAttachment}};
+
+  if (multisampled) {
+    graphColor = addGraphImage(frameGraph, "msaa color",
+                               vkctx.swapchainImageFormat,
+                               vkctx.swapchainExtent, vkctx.samples);
+    renderUses.push_back({graphColor, GraphAccess::ColorAttachment});
+  }
+
+  if (vkctx.gpuDriven) {
+    graphIndirect = importGraphBuffer(frameGraph, "indirect draws");
+    addGraphPass(frameGraph, "clear draw count",
+                 {{graphIndirect, GraphAccess::TransferWrite}},
+                 clearDrawCount);
+    addGraphPass(frameGraph, "culling",
+                 {{graphIndirect, GraphAccess::ComputeWrite}}, recordCulling);
+    prepassUses.push_back({graphIndirect, GraphAccess::IndirectRead});
+    renderUses.push_back({graphIndirect, GraphAccess::IndirectRead});
+  }
+
+  if (vkctx.depthPrepass)
+    addGraphPass(frameGraph, "depth prepass", prepassUses, recordDepthPrepass);
+  addGraphPass(frameGraph, "render pass", renderUses, recordRenderPass);
+  compileGraph(frameGraph);
+  createFramebuffers(graphImageView(frameGraph, graphDepth),
+                     multisampled ? graphImageView(frameGraph, graphColor)
+                                  : vk::ImageView());
+}
+
+static void recordCommandBuffer(uint32_t imageIndex) {
+  PROFILE_ZONE("record");
+  const auto& buffer = vkctx.commandBuffers[vkctx.currentFrame];
+  uint32_t firstQuery = vkctx.currentFrame * 2;
+
+  vk::CommandBufferBeginInfo beginInfo(
+      vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+  buffer.begin(beginInfo);
 
-    buffer.end();
+  if (vkctx.timestamps) {
+    buffer.resetQueryPool(vkctx.timestampPool, firstQuery, 2);
+    buffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe,
+                          vkctx.timestampPool, firstQuery);
   }
+  if (vkctx.overdrawStats)
+    buffer.resetQueryPool(vkctx.overdrawPool, vkctx.currentFrame, 1);
+
+  bindGraphImage(frameGraph, graphTarget, vkctx.swapchainImages[imageIndex],
+                 vkctx.swapchainImageViews[imageIndex]);
+  if (vkctx.gpuDriven)
+    bindGraphBuffer(frameGraph, graphIndirect,
+                    vkctx.indirectBuffers[vkctx.currentFrame]);
+  graphImageIndex = imageIndex;
+  executeGraph(frameGraph, buffer);
+
+  if (vkctx.timestamps)
+    buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe,
+                          vkctx.timestampPool, firstQuery + 1);
+
+  buffer.end();
 }
 
 static void createSyncObjects() {
   vk::SemaphoreCreateInfo sInfo;
   vk::FenceCreateInfo fInfo(vk::FenceCreateFlagBits::eSignaled);
   vkctx.imagesInFlight.resize(vkctx.swapchainImages.size());
-  for (uint8_t i = 0; i < vkctx.MAX_FRAMES_IN_FLIGHT; i++) {
+  for (uint32_t i = 0; i < vkctx.framesInFlight; i++) {
     vkctx.imageSemaphores.push_back(vkctx.device.createSemaphore(sInfo));
     vkctx.renderSemaphores.push_back(vkctx.device.createSemaphore(sInfo));
     vkctx.inFlightFences.push_back(vkctx.device.createFence(fInfo));
@@ -719,43 +1512,131 @@ static void createSyncObjects() {
 }
 
 static void cleanupSwapchain() {
-
   for (const auto& framebuffer : vkctx.framebuffers) {
     vkctx.device.destroyFramebuffer(framebuffer);
   }
+  vkctx.device.destroyFramebuffer(vkctx.depthFramebuffer);
 
-  vkctx.device.freeCommandBuffers(vkctx.commandPool, vkctx.commandBuffers);
-  vkctx.device.destroyRenderPass(vkctx.renderPass);
+  destroyRenderPasses();
 
   for (const auto& imageView : vkctx.swapchainImageViews) {
     vkctx.device.destroyImageView(imageView);
   }
 
-  vkctx.device.destroySwapchainKHR(vkctx.swapchain);
-
-  for (size_t i = 0; i < vkctx.swapchainImages.size(); i++) {
-    vmaDestroyBuffer(vkctx.allocator, vkctx.uniformBuffers[i],
-                     vkctx.uniformAllocations[i]);
+  if (vkctx.headless) {
+    for (size_t i = 0; i < vkctx.swapchainImages.size(); i++) {
+      vmaDestroyImage(vkctx.allocator, vkctx.swapchainImages[i],
+                      vkctx.offscreenAllocations[i]);
+    }
+  } else {
+    vkctx.device.destroySwapchainKHR(vkctx.swapchain);
   }
-  vkctx.device.destroyDescriptorPool(vkctx.descriptorPool);
 }
 
+// doesn't wait for the gpu, frames in flight finish with the old swapchain
+// and its views and framebuffers, which are destroyed after them
 static void recreateSwapchain() {
-  vkctx.device.waitIdle();
+  PROFILE_ZONE("recreate swapchain");
+
+  vk::SwapchainKHR oldSwapchain = vkctx.swapchain;
+  deferDestroy([oldSwapchain,
+                imageViews = std::move(vkctx.swapchainImageViews),
+                framebuffers = std::move(vkctx.framebuffers),
+                depthFramebuffer = vkctx.depthFramebuffer] {
+    for (const auto& framebuffer : framebuffers)
+      vkctx.device.destroyFramebuffer(framebuffer);
+    vkctx.device.destroyFramebuffer(depthFramebuffer);
+    for (const auto& imageView : imageViews)
+      vkctx.device.destroyImageView(imageView);
+    vkctx.device.destroySwapchainKHR(oldSwapchain);
+  });
+
+  vk::Format oldFormat = vkctx.swapchainImageFormat;
+  createSwapchain(oldSwapchain);
+  createImageViews();
 
-  cleanupSwapchain();
+  // the render pass only depends on the format and the pipelines were built
+  // against it or the format itself, this is rare enough to just wait, the
+  // old pipelines stay with the pipeline manager until cleanup
+  if (vkctx.swapchainImageFormat != oldFormat) {
+    vkctx.device.waitIdle();
+    waitForPipelines();
+    destroyRenderPasses();
+    createRenderPass();
+    requestPipelines();
+  }
 
-  createSwapchain();
-  createImageViews();
-  createRenderPass();
-  createFramebuffers();
-  createUniformBuffers();
-  createDescriptorPool();
-  createDescriptorSets();
-  createCommandBuffers();
+  // the framebuffers are created along with the graph's new depth image
+  destroyGraph(frameGraph);
+  buildFrameGraph();
+
+  // none of the new images are in use yet, and their count can change with
+  // the present mode
+  vkctx.imagesInFlight.assign(vkctx.swapchainImages.size(), std::nullopt);
 }
 
-static void updateUniformBuffer(uint32_t imageIndex) {
+void setPresentPolicy(PresentPolicy policy) {
+  vkctx.presentPolicy = policy;
+  vkctx.framebufferResized = true;
+}
+
+// the new view's pipelines are built on jobs, frames are drawn with the
+// textured ones until they're ready
+void setShadingView(ShadingView view) {
+  vkctx.shadingView = view;
+  requestPipelines();
+}
+
+// sleeps are only accurate to around a millisecond so the end of the wait is
+// spun, a frame that starts late pushes the following ones back instead of
+// letting them catch up
+static void limitFrameRate() {
+  if (vkctx.targetFrameTime <= 0.0)
+    return;
+  PROFILE_ZONE("frame limiter");
+
+  auto now = std::chrono::steady_clock::now();
+  if (vkctx.nextFrameStart > now) {
+    auto coarse = vkctx.nextFrameStart - std::chrono::milliseconds(1);
+    if (coarse > now)
+      std::this_thread::sleep_until(coarse);
+    while (std::chrono::steady_clock::now() < vkctx.nextFrameStart)
+      std::this_thread::yield();
+  }
+
+  auto frameStart = std::max(now, vkctx.nextFrameStart);
+  vkctx.nextFrameStart =
+      frameStart +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double, std::milli>(vkctx.targetFrameTime));
+}
+
+// true unless all of the mesh's bounding box corners are outside the same
+// clip plane
+static bool insideFrustum(const glm::mat4& mvp,
+                          std::array<glm::vec4, 8> corners) {
+  for (auto& corner : corners)
+    corner = mvp * corner;
+
+  for (int axis = 0; axis < 3; axis++) {
+    bool allBelow = true, allAbove = true;
+    for (const auto& corner : corners) {
+      // vulkan's clip space z runs from 0 to w, x and y from -w to w
+      float low = axis == 2 ? 0.0f : -corner.w;
+      allBelow = allBelow && corner[axis] < low;
+      allAbove = allAbove && corner[axis] > corner.w;
+    }
+    if (allBelow || allAbove)
+      return false;
+  }
+
+  return true;
+}
+
+// builds this frame's draw list, drawCount copies of the quad laid out on a
+// grid, transformed and culled as jobs with their MVPs in the uniform arena
+static void updateUniformBuffer() {
+  PROFILE_ZONE("update scene");
   static auto startTime = std::chrono::high_resolution_clock::now();
 
   auto currentTime = std::chrono::high_resolution_clock::now();
@@ -763,133 +1644,401 @@ static void updateUniformBuffer(uint32_t imageIndex) {
                    currentTime - startTime)
                    .count();
 
-  MVP buffer;
-
-  buffer.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f),
-                             glm::vec3(0.0f, 0.0f, 1.0f));
-  buffer.view = glm::lookAt(glm::vec3(2.0f), glm::vec3(0.0f),
-                            glm::vec3(0.0f, 0.0f, 1.0f));
-  buffer.proj =
+  glm::mat4 view = glm::lookAt(glm::vec3(2.0f), glm::vec3(0.0f),
+                               glm::vec3(0.0f, 0.0f, 1.0f));
+  glm::mat4 proj =
       glm::perspective(glm::radians(45.0f),
                        static_cast<float>(vkctx.swapchainExtent.width /
                                           vkctx.swapchainExtent.height),
                        0.1f, 10.0f);
-  buffer.proj[1][1] *= -1;
-  VmaAllocationInfo info;
-  vmaGetAllocationInfo(vkctx.allocator, vkctx.uniformAllocations[imageIndex],
-                       &info);
-  void* data =
-      vkctx.device.mapMemory(info.deviceMemory, info.offset, info.size);
-  SDL_memcpy(data, &buffer, info.size);
-  vkctx.device.unmapMemory(info.deviceMemory);
+  proj[1][1] *= -1;
+
+  uint32_t side =
+      static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(
+          std::max<uint32_t>(vkctx.drawCount, 1)))));
+  float scale = 1.0f / side;
+
+  uint32_t chunks = std::clamp<uint32_t>(
+      (vkctx.drawCount + vkctx.MIN_DRAWS_PER_THREAD - 1) /
+          vkctx.MIN_DRAWS_PER_THREAD,
+      1, jobThreadCount());
+  uint32_t textureSlot = getTextureSlot(vkctx.sceneTexture);
+  const Mesh& mesh = getMesh(vkctx.sceneMesh);
+  glm::mat4 dequantize = meshDequantize(mesh);
+  std::array<glm::vec4, 8> meshBounds = meshCorners(mesh);
+  glm::vec4 meshSphere = meshBoundingSphere(mesh);
+  glm::vec4 meshCenter(glm::vec3(meshSphere), 1.0f);
+
+  // only the objects are written, culling and draws happen on the gpu
+  if (vkctx.gpuDriven) {
+    setCullView(proj * view);
+    GpuObject* objects = frameObjects();
+
+    parallelFor(
+        vkctx.drawCount, chunks,
+        [&](uint32_t, uint32_t first, uint32_t last) {
+          PROFILE_ZONE("transform chunk");
+          for (uint32_t i = first; i < last; i++) {
+            glm::vec3 position((i % side + 0.5f) * scale - 0.5f,
+                               (i / side + 0.5f) * scale - 0.5f, 0.0f);
+
+            GpuObject& object = objects[i];
+            object.model = glm::translate(glm::mat4(1.0f), position);
+            object.model = glm::rotate(object.model,
+                                       time * glm::radians(90.0f),
+                                       glm::vec3(0.0f, 0.0f, 1.0f));
+            object.model = glm::scale(object.model, glm::vec3(scale));
+            object.sphere = glm::vec4(glm::vec3(object.model * meshCenter),
+                                      scale * meshSphere.w);
+            object.model = object.model * dequantize;
+            object.indexCount = mesh.indexCount;
+            object.firstIndex = 0;
+            object.vertexOffset = 0;
+            object.textureSlot = textureSlot;
+          }
+        });
+
+    vkctx.draws.clear();
+    return;
+  }
+
+  // visible quads are packed into the instance buffer and drawn with one
+  // call, the uniform arena only holds the camera
+  if (vkctx.instanced) {
+    MVP camera;
+    camera.model = glm::mat4(1.0f);
+    camera.view = view;
+    camera.proj = proj;
+    uint32_t cameraOffset = pushUniforms(&camera, sizeof(camera));
+
+    std::vector<std::vector<InstanceData>> visible(chunks);
+
+    parallelFor(
+        vkctx.drawCount, chunks,
+        [&](uint32_t chunk, uint32_t first, uint32_t last) {
+          PROFILE_ZONE("transform chunk");
+          for (uint32_t i = first; i < last; i++) {
+            glm::vec3 position((i % side + 0.5f) * scale - 0.5f,
+                               (i / side + 0.5f) * scale - 0.5f, 0.0f);
+
+            InstanceData instance;
+            instance.model = glm::translate(glm::mat4(1.0f), position);
+            instance.model = glm::rotate(instance.model,
+                                         time * glm::radians(90.0f),
+                                         glm::vec3(0.0f, 0.0f, 1.0f));
+            instance.model = glm::scale(instance.model, glm::vec3(scale));
+            instance.model = instance.model * dequantize;
+
+            if (!insideFrustum(proj * view * instance.model, meshBounds))
+              continue;
+
+            instance.color = glm::vec4(1.0f);
+            instance.textureSlot = textureSlot;
+            visible[chunk].push_back(instance);
+          }
+        });
+
+    auto* instances = reinterpret_cast<InstanceData*>(
+        vkctx.instanceData[vkctx.currentFrame]);
+    uint32_t instanceCount = 0;
+    for (const auto& chunkInstances : visible) {
+      SDL_memcpy(instances + instanceCount, chunkInstances.data(),
+                 chunkInstances.size() * sizeof(InstanceData));
+      instanceCount += static_cast<uint32_t>(chunkInstances.size());
+    }
+
+    vkctx.draws.clear();
+    if (instanceCount > 0)
+      vkctx.draws.push_back({mesh.indexCount, 0, 0, cameraOffset,
+                             textureSlot, 0, instanceCount});
+    return;
+  }
+
+  // every draw gets a slot up front so the jobs can write them in parallel
+  vk::DeviceSize stride = (sizeof(MVP) + vkctx.uniformAlignment - 1) /
+                          vkctx.uniformAlignment * vkctx.uniformAlignment;
+  uint32_t baseOffset;
+  uint8_t* uniforms =
+      allocateUniforms(stride * std::max<uint32_t>(vkctx.drawCount, 1),
+                       baseOffset);
+
+  std::vector<std::vector<DrawCommand>> visible(chunks);
+
+  parallelFor(vkctx.drawCount, chunks,
+              [&](uint32_t chunk, uint32_t first, uint32_t last) {
+                PROFILE_ZONE("transform chunk");
+                MVP buffer;
+                buffer.view = view;
+                buffer.proj = proj;
+
+                for (uint32_t i = first; i < last; i++) {
+                  glm::vec3 position((i % side + 0.5f) * scale - 0.5f,
+                                     (i / side + 0.5f) * scale - 0.5f, 0.0f);
+
+                  buffer.model = glm::translate(glm::mat4(1.0f), position);
+                  buffer.model =
+                      glm::rotate(buffer.model, time * glm::radians(90.0f),
+                                  glm::vec3(0.0f, 0.0f, 1.0f));
+                  buffer.model = glm::scale(buffer.model, glm::vec3(scale));
+                  buffer.model = buffer.model * dequantize;
+
+                  if (!insideFrustum(proj * view * buffer.model, meshBounds))
+                    continue;
+
+                  SDL_memcpy(uniforms + i * stride, &buffer, sizeof(buffer));
+                  visible[chunk].push_back(
+                      {mesh.indexCount, 0, 0,
+                       static_cast<uint32_t>(baseOffset + i * stride),
+                       textureSlot, 0, 1});
+                }
+              });
+
+  vkctx.draws.clear();
+  for (const auto& draws : visible)
+    vkctx.draws.insert(vkctx.draws.end(), draws.begin(), draws.end());
 }
 
 void drawFrame() {
   if (vkctx.minimized)
     return;
-  vkctx.device.waitForFences(1, &vkctx.inFlightFences[vkctx.currentFrame],
-                             VK_TRUE, UINT64_MAX);
-
-  auto [result, imageIndex] = vkctx.device.acquireNextImageKHR(
-      vkctx.swapchain, UINT64_MAX, vkctx.imageSemaphores[vkctx.currentFrame],
-      nullptr);
+  PROFILE_ZONE("frame");
+  {
+    PROFILE_ZONE("wait for frame");
+    vkctx.device.waitForFences(1, &vkctx.inFlightFences[vkctx.currentFrame],
+                               VK_TRUE, UINT64_MAX);
+  }
+  limitFrameRate();
+
+  // this frame slot's command buffer, uniform arena and descriptor set are
+  // free again
+  retireResources();
+  profileFrame(vkctx.currentFrame);
+  collectTimestamps(vkctx.currentFrame);
+  collectOverdraw(vkctx.currentFrame);
+  vkctx.uniformHead = 0;
+  updateTextures();
+  updatePipelines();
+  bindTextures(vkctx.currentFrame);
+
+  uint32_t imageIndex;
+
+  if (vkctx.headless) {
+    imageIndex = vkctx.offscreenIndex;
+    vkctx.offscreenIndex =
+        (vkctx.offscreenIndex + 1) % vkctx.swapchainImages.size();
+  } else {
+    PROFILE_ZONE("acquire");
+    auto [result, index] = vkctx.device.acquireNextImageKHR(
+        vkctx.swapchain, UINT64_MAX, vkctx.imageSemaphores[vkctx.currentFrame],
+        nullptr);
 
-  if (result == vk::Result::eErrorOutOfDateKHR) {
-    recreateSwapchain();
-    return;
-  } else if (result != vk::Result::eSuccess &&
-             result != vk::Result::eSuboptimalKHR) {
-    throw std::runtime_error("failed to acquire swapchain image");
+    if (result == vk::Result::eErrorOutOfDateKHR) {
+      recreateSwapchain();
+      return;
+    } else if (result != vk::Result::eSuccess &&
+               result != vk::Result::eSuboptimalKHR) {
+      throw std::runtime_error("failed to acquire swapchain image");
+    }
+    imageIndex = index;
   }
 
-  if (vkctx.imagesInFlight[vkctx.currentFrame].has_value()) {
-    vkctx.device.waitForFences(
-        1, &vkctx.imagesInFlight[vkctx.currentFrame].value(), VK_TRUE,
-        UINT64_MAX);
+  // imagesInFlight is per image, the same image can be handed back to us
+  // while a different frame is still rendering to it
+  if (vkctx.imagesInFlight[imageIndex].has_value()) {
+    vkctx.device.waitForFences(1, &vkctx.imagesInFlight[imageIndex].value(),
+                               VK_TRUE, UINT64_MAX);
   }
 
-  vkctx.imagesInFlight[vkctx.currentFrame] =
-      vkctx.inFlightFences[vkctx.currentFrame];
+  vkctx.imagesInFlight[imageIndex] = vkctx.inFlightFences[vkctx.currentFrame];
 
   vk::PipelineStageFlags waitStages[] = {
       vk::PipelineStageFlagBits::eColorAttachmentOutput};
 
-  updateUniformBuffer(imageIndex);
+  updateUniformBuffer();
+  recordCommandBuffer(imageIndex);
 
   vk::SubmitInfo submitInfo(1, &vkctx.imageSemaphores[vkctx.currentFrame],
-                            waitStages, 1, &vkctx.commandBuffers[imageIndex], 1,
+                            waitStages, 1,
+                            &vkctx.commandBuffers[vkctx.currentFrame], 1,
                             &vkctx.renderSemaphores[vkctx.currentFrame]);
 
-  vkctx.device.resetFences(vkctx.inFlightFences[vkctx.currentFrame]);
+  // there is no acquire or present to synchronize with when headless
+  if (vkctx.headless) {
+    submitInfo.setWaitSemaphoreCount(0);
+    submitInfo.setSignalSemaphoreCount(0);
+  }
 
-  vkctx.graphicsQueue.submit(submitInfo,
-                             vkctx.inFlightFences[vkctx.currentFrame]);
+  vkctx.device.resetFences(vkctx.inFlightFences[vkctx.currentFrame]);
 
-  vk::PresentInfoKHR presentInfo(1, &vkctx.renderSemaphores[vkctx.currentFrame],
-                                 1, &vkctx.swapchain, &imageIndex, nullptr);
+  {
+    PROFILE_ZONE("submit");
+    vkctx.graphicsQueue.submit(submitInfo,
+                               vkctx.inFlightFences[vkctx.currentFrame]);
+  }
 
-  try {
-    vk::Result res = vkctx.presentQueue.presentKHR(presentInfo);
-    if (res == vk::Result::eSuboptimalKHR || vkctx.framebufferResized) {
+  if (vkctx.timestamps)
+    vkctx.timestampsPending[vkctx.currentFrame] = true;
+  if (vkctx.overdrawStats)
+    vkctx.overdrawPending[vkctx.currentFrame] = true;
+
+  if (!vkctx.headless) {
+    PROFILE_ZONE("present");
+    vk::PresentInfoKHR presentInfo(
+        1, &vkctx.renderSemaphores[vkctx.currentFrame], 1, &vkctx.swapchain,
+        &imageIndex, nullptr);
+
+    try {
+      vk::Result res = vkctx.presentQueue.presentKHR(presentInfo);
+      if (res == vk::Result::eSuboptimalKHR || vkctx.framebufferResized) {
+        recreateSwapchain();
+        vkctx.framebufferResized = false;
+      }
+    } catch (vk::OutOfDateKHRError) {
       recreateSwapchain();
       vkctx.framebufferResized = false;
     }
-  } catch (vk::OutOfDateKHRError) {
-    recreateSwapchain();
-    vkctx.framebufferResized = false;
   }
-  vkctx.currentFrame = (vkctx.currentFrame + 1) % vkctx.MAX_FRAMES_IN_FLIGHT;
+  if (vkctx.frameNumber == 0)
+    finishStartup();
+  vkctx.currentFrame = (vkctx.currentFrame + 1) % vkctx.framesInFlight;
+  vkctx.frameNumber++;
 }
 
+// the steps run in order on the main thread, the shaders are compiled into
+// the binary so only the pipeline cache is read by a job while the instance
+// and device are created, jobs decode the scene texture while the rest is
+// set up, each step's time is printed once the first frame is submitted
+// startup is a small dependency graph, anything that creates vulkan objects
+// runs in order on the main thread while cpu only work like mapping and
+// checking the scene mesh runs on jobs, steps name the jobs they wait for
 void initVulkan() {
-  createInstance();
+  vkctx.framesInFlight =
+      std::clamp(vkctx.framesInFlight, 1u, vkctx.MAX_FRAMES_IN_FLIGHT);
+  startupStep("init jobs", [] { initJobs(0); });
+
+  preloadFile(vkctx.pipelineCachePath);
+
+  // the mesh's layout picks the pipelines' vertex input, nothing before
+  // that needs it, static so the job can't outlive it if a step throws
+  static JobCounter sceneLoaded;
+  startupJob(
+      "load scene mesh",
+      [] { vkctx.sceneMesh = loadSceneMesh(vkctx.meshPath.c_str()); },
+      sceneLoaded);
+
+  startupStep("create instance", [] {
+    createInstance();
 #ifdef USE_VALIDATION_LAYERS
-  setupDebugMessenger();
+    setupDebugMessenger();
 #endif
-  createSurface();
-  pickPhysicalDevice();
-  createDevice();
-  createAllocator();
-  createSwapchain();
-  createImageViews();
-  createRenderPass();
-  createDescriptorSetLayout();
-  createPipeline();
-  createFramebuffers();
-  createCommandPool();
-  createTextureImage();
-  createTextureImageView();
-  createTextureSampler();
-  createVertexBuffer();
-  createIndexBuffer();
-  createUniformBuffers();
-  createDescriptorPool();
-  createDescriptorSets();
-  createCommandBuffers();
-  createSyncObjects();
+  });
+  if (!vkctx.headless)
+    startupStep("create surface", createSurface);
+  startupStep("pick physical device", pickPhysicalDevice);
+  startupStep("load scene texture", [] {
+    // decoding doesn't need the device, only to know what it can sample, it
+    // already happens on a job
+    vkctx.sceneTexture = loadTexture("textures/img.png");
+  });
+  startupStep("create device", [] {
+    createDevice();
+    pickDepthFormat();
+    pickSampleCount();
+    createAllocator();
+  });
+  startupStep("create swapchain", [] {
+    if (vkctx.headless)
+      createOffscreenImages();
+    else
+      createSwapchain();
+    createImageViews();
+    createRenderPass();
+  });
+  startupStep("init gpu services", [] {
+    createTimestampPool();
+    createOverdrawPool();
+    createCommandPool();
+    initProfiler();
+    initUploads();
+    initTextures();
+  });
+  startupStep(
+      "create pipelines",
+      [] {
+        createDescriptorSetLayout();
+        createPipelineCache();
+        createPipeline();
+      },
+      {&sceneLoaded});
+  startupStep("upload scene", [] {
+    createMeshBuffers(vkctx.sceneMesh);
+    // nothing waits on this, the graphics queue orders rendering after it
+    submitUploads();
+  });
+  startupStep("create frame resources", [] {
+    createUniformBuffers();
+    if (vkctx.instanced)
+      createInstanceBuffers();
+    createDescriptorPool();
+    createDescriptorSets();
+    createCommandBuffers();
+    initRecording();
+  });
+  if (vkctx.gpuDriven)
+    startupStep("init culling", initCulling);
+  startupStep("build frame graph", [] {
+    buildFrameGraph();
+    createSyncObjects();
+  });
 }
 
 void cleanupVulkan() {
+  // build jobs use the pipeline layouts
+  cleanupPipelines();
+  if (vkctx.gpuDriven)
+    cleanupCulling();
+  cleanupRecording();
   cleanupSwapchain();
-  vkctx.device.destroySampler(vkctx.textureSampler);
-  vkctx.device.destroyImageView(vkctx.textureImageView);
-  vmaDestroyImage(vkctx.allocator, vkctx.textureImage, vkctx.textureAllocation);
+  if (vkctx.timestamps)
+    vkctx.device.destroyQueryPool(vkctx.timestampPool);
+  if (vkctx.overdrawStats)
+    vkctx.device.destroyQueryPool(vkctx.overdrawPool);
+  vkctx.device.destroyDescriptorPool(vkctx.descriptorPool);
+  if (vkctx.bindless)
+    vkctx.device.destroyDescriptorPool(vkctx.texturePool);
+  cleanupUniformBuffers();
+  if (vkctx.instanced)
+    cleanupInstanceBuffers();
+  cleanupTextures();
   vkctx.device.destroyDescriptorSetLayout(vkctx.descriptorLayout);
-  vmaDestroyBuffer(vkctx.allocator, vkctx.vertexBuffer, vkctx.vertexAllocation);
-  vmaDestroyBuffer(vkctx.allocator, vkctx.indexBuffer, vkctx.indexAllocation);
+  if (vkctx.bindless)
+    vkctx.device.destroyDescriptorSetLayout(vkctx.textureLayout);
+  destroyGraph(frameGraph);
+  destroyImage(vkctx.sceneTexture);
+  destroyMesh(vkctx.sceneMesh);
+  // also destroys the swapchains retired by recreateSwapchain
+  cleanupResources();
+  cleanupUploads();
+  cleanupProfiler();
   vmaDestroyAllocator(vkctx.allocator);
-  vkctx.device.destroyPipeline(vkctx.pipeline);
   vkctx.device.destroyPipelineLayout(vkctx.pipelineLayout);
-  for (uint8_t i = 0; i < vkctx.MAX_FRAMES_IN_FLIGHT; i++) {
+  savePipelineCache();
+  vkctx.device.destroyPipelineCache(vkctx.pipelineCache);
+  if (vkctx.pipelineFeedback)
+    std::cerr << "pipeline cache: " << vkctx.pipelineCacheHits << " hits, "
+              << vkctx.pipelineCacheMisses << " misses" << std::endl;
+  for (uint32_t i = 0; i < vkctx.framesInFlight; i++) {
     vkctx.device.destroySemaphore(vkctx.imageSemaphores[i]);
     vkctx.device.destroySemaphore(vkctx.renderSemaphores[i]);
     vkctx.device.destroyFence(vkctx.inFlightFences[i]);
   }
   vkctx.device.destroyCommandPool(vkctx.commandPool);
-  vkctx.instance.destroySurfaceKHR(vkctx.surface);
+  if (!vkctx.headless)
+    vkctx.instance.destroySurfaceKHR(vkctx.surface);
   vkctx.device.destroy();
 #ifdef USE_VALIDATION_LAYERS
   DestroyDebugUtilsMessengerEXT(vkctx.debugMessenger);
 #endif
   vkctx.instance.destroy();
+  cleanupJobs();
 }